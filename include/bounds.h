@@ -0,0 +1,77 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+struct BoundingSphere
+{
+    glm::vec3 centre = {};
+    float radius = 0.0f;
+
+    BoundingSphere transformed(const glm::mat4& matrix) const
+    {
+        // Non-uniform scale means the largest axis wins
+        const float scale = std::sqrt(std::max({
+            glm::dot(glm::vec3(matrix[0]), glm::vec3(matrix[0])),
+            glm::dot(glm::vec3(matrix[1]), glm::vec3(matrix[1])),
+            glm::dot(glm::vec3(matrix[2]), glm::vec3(matrix[2]))
+        }));
+        return { glm::vec3(matrix * glm::vec4(centre, 1.0f)), radius * scale };
+    }
+};
+
+struct AABB
+{
+    glm::vec3 min = {};
+    glm::vec3 max = {};
+
+    glm::vec3 centre() const { return (min + max) * 0.5f; }
+    glm::vec3 extents() const { return (max - min) * 0.5f; }
+
+    // Still axis-aligned afterwards, so may be looser than the original
+    AABB transformed(const glm::mat4& matrix) const
+    {
+        const glm::vec3 new_centre = glm::vec3(matrix * glm::vec4(centre(), 1.0f));
+        const glm::vec3 old_extents = extents();
+        const glm::vec3 new_extents =
+            glm::abs(glm::vec3(matrix[0])) * old_extents.x +
+            glm::abs(glm::vec3(matrix[1])) * old_extents.y +
+            glm::abs(glm::vec3(matrix[2])) * old_extents.z;
+        return { new_centre - new_extents, new_centre + new_extents };
+    }
+
+    // From interleaved XYZ positions
+    static AABB from_vertices(const std::vector<float>& vertices)
+    {
+        if (vertices.empty()) return {};
+
+        AABB bounds =
+        {
+            glm::vec3(std::numeric_limits<float>::max()),
+            glm::vec3(std::numeric_limits<float>::lowest())
+        };
+        for (size_t i = 0; i + 2 < vertices.size(); i += 3)
+        {
+            const glm::vec3 vertex = { vertices[i], vertices[i + 1], vertices[i + 2] };
+            bounds.min = glm::min(bounds.min, vertex);
+            bounds.max = glm::max(bounds.max, vertex);
+        }
+        return bounds;
+    }
+};
+
+// Centred on the AABB, but only as large as the furthest vertex needs
+inline BoundingSphere bounding_sphere_from_vertices(const std::vector<float>& vertices, const AABB& bounds)
+{
+    BoundingSphere sphere = { bounds.centre(), 0.0f };
+    float radius_squared = 0.0f;
+    for (size_t i = 0; i + 2 < vertices.size(); i += 3)
+    {
+        const glm::vec3 offset = glm::vec3 { vertices[i], vertices[i + 1], vertices[i + 2] } - sphere.centre;
+        radius_squared = std::max(radius_squared, glm::dot(offset, offset));
+    }
+    sphere.radius = std::sqrt(radius_squared);
+    return sphere;
+}
@@ -1,8 +1,7 @@
 #pragma once
 #include <memory>
 #include "transform.h"
-#include "texture.h"
-#include "mesh.h"
+#include "resources.h"
 
 enum class Block
 {
@@ -30,7 +29,7 @@ public:
     ~Chunk();
 
     // State common to all chunks
-    static Texture* texture;
+    static TextureRef texture;
     static constexpr int size = 32;
     static constexpr int max_height = 256;
 
@@ -23,6 +23,7 @@ struct CloudSettings
     float threshold = 0.75f;
     float brightness = 11.0f;
     float texture_scale = default_texture_scale;
+    float shadow_density = 0.1f;
 
     // Quality
     int steps = 256;
@@ -36,6 +37,7 @@ struct CloudSettings
         ImGui::SliderFloat("Threshold", &threshold, 0.0f, 1.0f);
         ImGui::SliderFloat("Brightness", &brightness, 0.0f, 20.0f);
         ImGui::SliderFloat("Texture scale", &texture_scale, 0.0f, 10.0f);
+        ImGui::SliderFloat("Shadow density", &shadow_density, 0.0f, 1.0f);
         ImGui::SliderInt("Steps", &steps, 1, 1024);
         bool should_recalculate = ImGui::Button("Recalculate noise");
         ImGui::End();
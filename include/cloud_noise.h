@@ -0,0 +1,13 @@
+#pragma once
+#include <vector>
+
+// CPU port of what was worley.comp - tileable Perlin-Worley volumes for the
+// clouds. Slices are shared out between threads, and each is generated four
+// texels at a time with SSE (where available). Results are cached on disk,
+// keyed by size and scale, so only the first run with a given scale pays.
+namespace cloud_noise
+{
+    // size^3 texels (x fastest, then y, then z), each in [0, 1]
+    std::vector<float> generate(const unsigned int size, const float scale, const bool just_perlin);
+    std::vector<float> load_or_generate(const unsigned int size, const float scale, const bool just_perlin);
+}
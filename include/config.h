@@ -1,7 +1,36 @@
 #pragma once
-#define BAKE_SHADOWMAPS false
 #define RENDER_SCALE 1.0f
-#define SHADOWMAP_RESOLUTION 8192
-#define REFLECTION_RESOLUTION 1024
+#define SHADOWMAP_RESOLUTION 2048
+#define SHADOW_CASCADES 4
+#define SHADOW_DISTANCE 150.0f
+#define SHADOW_SPLIT_LAMBDA 0.75f
+#define SHADOW_CACHING true
+#define SHADOW_URGENT_MOVE 0.25f
+#define SHADOW_URGENT_ANGLE 2.0f
+#define SHADOW_FILTER ShadowFilter::HardwarePCF
+#define BLUR_RADIUS 6
+#define BLUR_SIGMA 2.4f
+#define BLOOM_MIPS 6
+#define CLOUD_SHADOW_RESOLUTION 512
+#define OFFSCREEN_VIEW_BUDGET_MS 2.0f
+#define GPU_PROFILER_LATENCY 4
+#define GPU_PROFILER_HISTORY 240
+#define GPU_PROFILER_CSV "gpu_profile.csv"
+#define CPU_PROFILER true
+#define CPU_PROFILER_BUFFER_SIZE 16384
+#define CPU_PROFILER_SPIKE_FACTOR 2.0f
+#define CPU_PROFILER_CAPTURE_FRAMES 300
+#define CPU_PROFILER_TRACE "cpu_trace.json"
+#define HEADLESS_MIN_SIZE 16
 #define DEBUG true
 #define VSYNC true
+#define TEXTURE_STREAMING true
+#define TEXTURE_BUDGET_MB 512
+#define TEXTURE_UPLOAD_BUDGET_KB 4096
+#define TEXTURE_BASE_MIP_SIZE 64
+#define RESOURCE_PURGE_INTERVAL 600
+#define SHADER_CACHE true
+#define SHADER_CACHE_DIRECTORY "shader_cache/"
+#define CLOUD_NOISE_CACHE true
+#define CLOUD_NOISE_CACHE_DIRECTORY "cloud_noise_cache/"
+#define MAX_INSTANCES 65536
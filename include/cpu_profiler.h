@@ -0,0 +1,60 @@
+#pragma once
+#include "config.h"
+#include <cstdint>
+
+// Scoped CPU zones - PROFILE_ZONE("name") times the rest of the enclosing
+// scope, and PROFILE_FUNCTION() the whole function. Zones nest, and may be
+// opened on any thread: each thread writes to its own ring buffer without
+// locking, and the main thread drains them all in end_frame(). Names must
+// outlive the profiler (string literals, __func__).
+//
+// With CPU_PROFILER off, the macros expand to nothing and the rest are empty
+// inline functions, so none of it costs anything.
+#if CPU_PROFILER
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) cpu_profiler::Zone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+
+namespace cpu_profiler
+{
+    // Nanoseconds since the profiler started
+    uint64_t now();
+
+    class Zone
+    {
+    public:
+        explicit Zone(const char* name);
+        Zone(const Zone&) = delete;
+        ~Zone();
+
+    private:
+        const char* name;
+        uint64_t begin;
+    };
+
+    // Called once a frame from the main thread - drains every thread's zones,
+    // reports frame time spikes (with the slowest zones behind them) and
+    // writes out captures once they're done
+    void end_frame();
+    void draw_gui();
+
+    // Records the next few frames' zones as Chrome/Perfetto trace JSON
+    // (load it at ui.perfetto.dev, or chrome://tracing)
+    void start_capture(const unsigned int frames, const char* filename = CPU_PROFILER_TRACE);
+}
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+
+namespace cpu_profiler
+{
+    inline void end_frame() {}
+    inline void draw_gui() {}
+    inline void start_capture(const unsigned int, const char* = nullptr) {}
+}
+
+#endif
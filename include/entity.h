@@ -12,4 +12,7 @@ public:
 
     std::vector<TexturedMesh> textured_meshes;
     Transform transform = {};
+
+    // Static entities' shadows are cached (see ShadowMap)
+    bool is_static = true;
 };
\ No newline at end of file
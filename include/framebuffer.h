@@ -25,12 +25,14 @@ public:
     void bind() const;
     void unbind(unsigned int previous_width, unsigned int previous_height) const;
 
+    // Copies the colour attachment into another framebuffer (of the same size)
+    void blit_colour(const Framebuffer& target) const;
+
     unsigned int width;
     unsigned int height;
 
     std::optional<Texture> colour_texture;
     std::optional<Texture> normal_texture;
-    std::optional<Texture> position_texture;
     std::optional<Texture> depth_map;
 
 private:
@@ -0,0 +1,30 @@
+#pragma once
+#include "bounds.h"
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+// Tests batches of world-space AABBs against a frustum, four at a time. Bounds
+// are kept as structure-of-arrays (centres and extents per axis) so each SIMD
+// lane handles a different box.
+class FrustumCuller
+{
+public:
+    void clear();
+    uint32_t add(const AABB& bounds);
+
+    // Fills visible[i] for every box added since clear() - shadow casters
+    // can be in front of the near plane, so it can be left out
+    void cull(
+        const glm::mat4& view_projection,
+        std::vector<uint8_t>& visible,
+        const bool test_near_plane = true
+    ) const;
+
+    size_t size() const { return count; }
+
+private:
+    std::vector<float> centre_x, centre_y, centre_z;
+    std::vector<float> extent_x, extent_y, extent_z;
+    size_t count = 0;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+// Thin cache in front of the GL calls we make most often - anything that
+// wouldn't change the current state is skipped. Whatever bypasses it (ImGui,
+// say) must be followed by invalidate()
+namespace gl_state
+{
+    struct Stats
+    {
+        unsigned int issued = 0;
+        unsigned int skipped = 0;
+    };
+
+    void use_program(const unsigned int program);
+    void bind_vertex_array(const unsigned int vao);
+    void bind_framebuffer(const unsigned int fbo);
+    void viewport(const int x, const int y, const int width, const int height);
+    void bind_texture(const unsigned int unit, const unsigned int target, const unsigned int texture);
+    void set_enabled(const unsigned int capability, const bool enabled);
+    void cull_face(const unsigned int mode);
+
+    // GL names get reused, so anything deleted must be forgotten
+    void forget_program(const unsigned int program);
+    void forget_vertex_array(const unsigned int vao);
+    void forget_framebuffer(const unsigned int fbo);
+    void forget_texture(const unsigned int texture);
+
+    void invalidate();
+
+    // Only counted in debug builds
+    Stats get_stats();
+    void reset_stats();
+}
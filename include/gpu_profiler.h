@@ -0,0 +1,77 @@
+#pragma once
+#include "config.h"
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdint>
+
+// Times each section of the frame on the GPU. Sections can nest, so they're
+// timed with pairs of timestamp queries rather than GL_TIME_ELAPSED (which
+// can't nest, and is left free for the view scheduler). Queries are kept in a
+// ring of frames and only read back once the ring comes round again, so
+// reading them never stalls.
+class GPUProfiler
+{
+public:
+    GPUProfiler() {}
+    GPUProfiler(const GPUProfiler&) = delete;
+    ~GPUProfiler();
+
+    // Everything between these is also timed as a whole, as "Frame"
+    void begin_frame();
+    void end_frame();
+
+    void begin(const std::string& name);
+    void end();
+
+    // Averages and maxima over the last GPU_PROFILER_HISTORY frames, plus
+    // recording every frame's timings to a CSV file
+    void draw_gui();
+    void write_csv(const std::string& filename) const;
+
+private:
+    struct Section
+    {
+        std::string name;
+        unsigned int depth;
+        std::array<float, GPU_PROFILER_HISTORY> history = {};
+        unsigned int samples = 0;
+        float average = 0.0f;
+        float max = 0.0f;
+    };
+
+    struct Timing
+    {
+        unsigned int section;
+        unsigned int begin_query;
+        unsigned int end_query;
+    };
+
+    struct Frame
+    {
+        uint64_t number = 0;
+        std::vector<unsigned int> queries;
+        unsigned int queries_used = 0;
+        std::vector<Timing> timings;
+    };
+
+    unsigned int get_section(const std::string& name);
+    unsigned int get_query(Frame& frame);
+    void collect(Frame& frame);
+
+    std::array<Frame, GPU_PROFILER_LATENCY> frames;
+    std::vector<Section> sections;
+    std::vector<unsigned int> open_timings;
+    uint64_t frame_number = 0;
+    unsigned int dropped_frames = 0;
+
+    // Milliseconds per section (negative where it didn't run) for each frame
+    // since recording began
+    struct Row
+    {
+        uint64_t frame;
+        std::vector<float> timings;
+    };
+    bool recording = false;
+    std::vector<Row> recorded;
+};
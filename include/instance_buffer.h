@@ -0,0 +1,28 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+// Per-instance model matrices, shared by every mesh's VAO (attributes 4 to 7)
+// and indexed with a base instance - one buffer means meshes never need
+// re-binding, and passes just append their transforms each frame
+class InstanceBuffer
+{
+public:
+    InstanceBuffer(const uint32_t capacity);
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    ~InstanceBuffer();
+
+    // Call with the target VAO bound
+    void bind_attributes() const;
+
+    // Returns the base instance to draw the transforms with
+    uint32_t upload(const std::vector<glm::mat4>& transforms);
+
+    static constexpr unsigned int first_attribute = 4;
+
+private:
+    unsigned int vbo;
+    uint32_t capacity;
+    uint32_t cursor = 0;
+};
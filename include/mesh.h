@@ -1,7 +1,9 @@
 #pragma once
 #include <vector>
 #include <cstddef>
+#include <cstdint>
 #include <optional>
+#include "bounds.h"
 
 class Mesh
 {
@@ -22,6 +24,11 @@ public:
     void bind() const;
     void unbind() const;
     void draw() const;
+    void draw_instanced(const uint32_t count, const uint32_t base_instance) const;
+
+    // Object-space, for culling
+    AABB bounds;
+    BoundingSphere bounding_sphere;
 
 private:
 
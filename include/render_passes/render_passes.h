@@ -1,6 +1,30 @@
 #pragma once
 #include "../shader.h"
 #include "../scene.h"
+#include "../render_queue.h"
+#include "../frustum_culler.h"
+#include "../gl_state.h"
+#include "../view_scheduler.h"
+#include <memory>
+
+// Per-frame data, uploaded once into a std140 uniform block that every shader
+// can read - must match res/shaders/frame.glsl
+struct FrameUniforms
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 view_projection;
+    glm::mat4 inverse_view_projection;
+    glm::mat4 previous_view_projection; // for reprojecting last frame
+    glm::mat4 lightspace[max_shadow_cascades]; // per cascade
+    glm::vec4 camera_position;
+    glm::vec4 sun_position;
+    glm::vec4 sun_colour;
+    glm::vec4 screen; // width, height, z_near, z_far
+    glm::vec4 cascade_splits; // view-space far distance of each cascade
+    glm::vec4 shadow_settings; // cascade count, filter, unused, unused
+    glm::vec4 cloud_shadow_area; // min x, min z, 1 / size, height of the cloud base
+};
 
 class RenderPass
 {
@@ -15,14 +39,22 @@ public:
     GBufferPass(const unsigned int width, const unsigned int height);
     void render(
         const Scene& scene,
-        const glm::mat4& view,
-        const glm::mat4& projection,
+        const FrameUniforms& frame,
         const std::optional<glm::vec4> clip_plane = {}
     );
     Framebuffer g_buffer;
 
 private:
     GBufferShader shader;
+    RenderQueue queue;
+    FrustumCuller culler;
+    std::vector<uint8_t> visible;
+
+    struct
+    {
+        Uniform<glm::vec4> clip_plane;
+        Uniform<int> has_normal_map;
+    } uniforms;
 };
 
 class LightingPass : public RenderPass
@@ -31,73 +63,139 @@ public:
     LightingPass(const unsigned int width, const unsigned int height);
     void render(
         const Scene& scene,
-        const glm::mat4& light_projection,
-        const Texture* cloud_noise,
-        const Texture& shadow_map,
+        const Texture& cloud_shadows,
+        const ShadowMap& shadow_map,
         const Texture& ambient_occlusion,
         const Framebuffer& g_buffer
     );
     Framebuffer output_framebuffer;
 private:
     LightingShader shader;
-    SkyboxShader skybox_shader;
+
+    struct
+    {
+        Uniform<glm::vec3> ambient_light;
+    } uniforms;
 };
 
 class SkyPass : public RenderPass
 {
 public:
     SkyPass();
-    void render(
-        const Scene& scene,
-        const glm::mat4& view,
-        const glm::mat4& projection,
-        const Framebuffer& g_buffer
-    );
+    void render(const Scene& scene, const Framebuffer& g_buffer);
 private:
     SkyboxShader shader;
+
+    struct
+    {
+        Uniform<glm::vec3> tint;
+    } uniforms;
 };
 
+// Refracts what's already been lit and traces reflections through a
+// hierarchical depth buffer, both taken from the main view - so water costs
+// no extra scene draws. Reflections that miss fall back to the skybox.
 class WaterPass : public RenderPass
 {
 public:
-    WaterPass();
+    WaterPass(const unsigned int width, const unsigned int height);
     void render(
         const Scene& scene,
-        const glm::mat4& view,
-        const glm::mat4& projection,
-        const glm::mat4& light_projection,
-        const Texture* cloud_noise,
+        const Framebuffer& g_buffer,
+        const Texture& cloud_shadows,
         const Framebuffer& output_framebuffer
     );
 
 private:
+    void build_depth_pyramid(const Texture& depth_map);
+
     WaterShader shader;
+    DepthPyramidShader depth_pyramid_shader;
+
+    // Copy of the lit scene (as we draw on top of it), and each level holding
+    // the nearest depth of the 2x2 texels above it
+    Framebuffer scene_colour;
+    Texture depth_pyramid;
+    unsigned int depth_pyramid_levels;
+
+    bool reflections = true;
+    float max_distance = 100.0f;
+    float thickness = 1.0f;
+
+    struct
+    {
+        Uniform<float> time;
+        Uniform<glm::mat4> model;
+        Uniform<int> has_skybox;
+        Uniform<glm::vec3> sky_tint;
+        Uniform<glm::vec3> sky_colour;
+        Uniform<int> reflections;
+        Uniform<float> max_distance;
+        Uniform<float> thickness;
+        Uniform<int> level;
+    } uniforms;
 };
 
 class ShadowPass : public RenderPass
 {
 public:
     ShadowPass();
-    void render(
-        const Scene& scene,
-        const glm::mat4& light_projection
-    );
+    void render(const Scene& scene, const FrameUniforms& frame);
 
 private:
+    enum class Casters
+    {
+        All,
+        Static,
+        Dynamic
+    };
+    void draw_casters(const Scene& scene, const Casters casters);
+    void update_moments(ShadowMap& shadow_map);
+
     ShadowMapShader shader;
+    EVSMShader evsm_shader;
+    RenderQueue queue;
+    FrustumCuller culler;
+    std::vector<uint8_t> visible;
+    std::vector<uint8_t> is_dynamic;
+    uint64_t last_static_signature = 0;
+
+    struct
+    {
+        Uniform<int> cascade;
+        Uniform<int> layer;
+        Uniform<int> horizontal;
+    } uniforms;
+
+    struct
+    {
+        unsigned int static_redraws = 0;
+        unsigned int dynamic_redraws = 0;
+        unsigned int moment_updates = 0;
+        unsigned int casters_drawn = 0;
+        unsigned int casters_culled = 0;
+    } stats;
 };
 
 class BlurPass : public RenderPass
 {
 public:
     BlurPass(const unsigned int width, const unsigned int height);
-    void render(const std::optional<Texture*> texture = {}, std::optional<Framebuffer*> output = {});
-    Framebuffer& get_default_input();
+    // Both directions go through a private intermediate, so the input may
+    // also be the output (or get_default_output())
+    void render(const Texture& texture, std::optional<Framebuffer*> output = {});
     Framebuffer& get_default_output();
 
 private:
+    void dispatch(const Texture& input, const Texture& output, const bool horizontal);
+
     BlurShader shader;
     Framebuffer framebuffers[2];
+
+    struct
+    {
+        Uniform<int> horizontal;
+    } uniforms;
 };
 
 class BloomPass : public RenderPass
@@ -108,8 +206,19 @@ public:
     Framebuffer& get_output();
 
 private:
-    BloomShader bloom_shader;
-    BlurPass blur_pass;
+    BloomDownsampleShader downsample_shader;
+    BloomUpsampleShader upsample_shader;
+
+    // Each level half the size of the one before (so a quarter of the pixels)
+    std::vector<std::unique_ptr<Framebuffer>> mips;
+
+    struct
+    {
+        Uniform<int> prefilter;
+        Uniform<float> threshold;
+        Uniform<float> intensity;
+        Uniform<float> radius;
+    } uniforms;
 };
 
 class SpritePass : public RenderPass
@@ -120,6 +229,11 @@ public:
 
 private:
     QuadShader shader;
+
+    struct
+    {
+        Uniform<glm::mat4> matrix;
+    } uniforms;
 };
 
 class CloudPass : public RenderPass
@@ -127,20 +241,70 @@ class CloudPass : public RenderPass
 public:
     CloudPass(const unsigned int width, const unsigned int height);
     ~CloudPass();
-    void render(
-        Scene& scene,
-        const glm::mat4& view,
-        const glm::mat4& projection,
-        const Texture& input_depth
-    );
-    Framebuffer output_framebuffer;
+    void render(Scene& scene, const Texture& input_depth);
+    Framebuffer& get_output();
     Texture* noises[2];
 
+    // For frames the pass is skipped - its history is stale by the time it's back
+    void invalidate_history();
+
+    // Sunlight let through the clouds, as seen from above - rendered before
+    // lighting, over the area given by get_shadow_area() (see cloud_shadow.glsl).
+    // It's an offscreen view, so only rendered when scheduled - straight away
+    // if the camera's carried the area too far, otherwise when there's time.
+    void update_shadow_area(const Scene& scene, ViewScheduler& scheduler);
+    void render_shadows(const Scene& scene);
+    glm::vec4 get_shadow_area() const;
+    Texture& get_shadows();
+
 private:
     void init(const float scale);
+    void get_bounds(const Scene& scene, glm::vec3& min_bounds, glm::vec3& max_bounds) const;
+
+    // Everything cloud_density.glsl needs
+    struct DensityUniforms
+    {
+        Uniform<glm::vec3> bounds_min;
+        Uniform<glm::vec3> bounds_max;
+        Uniform<float> offset;
+        Uniform<float> scale;
+        Uniform<float> detail_scale;
+        Uniform<float> density;
+        Uniform<float> threshold;
+    };
+    static DensityUniforms get_density_uniforms(Shader& shader);
+    void set_density_uniforms(const Shader& shader, const DensityUniforms& handles, const Scene& scene) const;
+
     CloudShader cloud_shader;
-    WorleyShader worley_shader;
-    BlurPass blur_pass;
+    CloudReprojectShader reproject_shader;
+    CloudShadowShader shadow_shader;
+    DensityUniforms density_uniforms;
+    DensityUniforms shadow_density_uniforms;
+
+    // One pixel in every block is traced each frame, then the rest are
+    // reprojected from the previous frame's output (ping-ponged)
+    Framebuffer trace_framebuffer;
+    Framebuffer history_framebuffers[2];
+    Framebuffer shadow_framebuffer;
+    OffscreenView shadow_view;
+    glm::vec4 shadow_area = {};
+    glm::vec4 next_shadow_area = {};
+    bool shadows_enabled = false;
+    unsigned int frame = 0;
+    bool history_valid = false;
+
+    struct
+    {
+        Uniform<glm::vec2> trace_offset;
+        Uniform<float> jitter;
+        Uniform<glm::vec3> reproject_bounds_min;
+        Uniform<glm::vec3> reproject_bounds_max;
+        Uniform<glm::vec2> reproject_trace_offset;
+        Uniform<int> history_valid;
+        Uniform<float> brightness;
+        Uniform<int> steps;
+        Uniform<float> shadow_density;
+    } uniforms;
 };
 
 class AmbientOcclusionPass : public RenderPass
@@ -149,16 +313,30 @@ public:
     AmbientOcclusionPass(const unsigned int width, const unsigned int height);
     ~AmbientOcclusionPass();
     void render(
-        const Texture& positions,
         const Texture& normals,
-        const Texture& depth,
-        const glm::mat4& view,
-        const glm::mat4& projection
+        const Texture& depth
     );
     Framebuffer output_framebuffer;
 private:
+    void render_half_resolution(const Texture& depth);
+
     BlurPass blur_pass;
     SSAOShader shader;
+
+    // Half resolution occlusion (ping-ponged for the blur), then upsampled
+    Framebuffer half_framebuffers[2];
+    BilateralBlurShader bilateral_blur_shader;
+    BilateralUpsampleShader bilateral_upsample_shader;
+    glm::vec2 noise_size;
+
+    struct
+    {
+        Uniform<float> radius;
+        Uniform<float> bias;
+        Uniform<float> sharpness;
+        Uniform<glm::vec2> noise_scale;
+        Uniform<int> horizontal;
+    } uniforms;
     Texture* noise;
 };
 
@@ -0,0 +1,101 @@
+#pragma once
+#include "texture.h"
+#include "mesh.h"
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+// Everything needed to issue a single draw call
+struct DrawPacket
+{
+    const Mesh* mesh;
+    const Texture* diffuse_texture;
+    const Texture* normal_map;
+    glm::mat4 model;
+};
+
+// Run of packets sharing shader, material and mesh, drawn as a single
+// instanced call
+struct DrawBatch
+{
+    const DrawPacket* packet; // the first one, for its state
+    uint8_t shader;
+    uint32_t first_instance;
+    uint32_t instance_count;
+};
+
+// Counted by whoever submits the queue, so we can see how much sorting saves
+struct RenderQueueStats
+{
+    unsigned int draws = 0;
+    unsigned int instances = 0;
+    unsigned int culled = 0;
+    unsigned int program_binds = 0;
+    unsigned int texture_binds = 0;
+    unsigned int mesh_binds = 0;
+    unsigned int uniform_updates = 0;
+};
+
+// Collects draws, then orders them by a 64-bit key so that the most expensive
+// state changes happen least often. From most to least significant:
+//  - shader   (8 bits)
+//  - material (16 bits)
+//  - mesh     (16 bits)
+//  - depth    (24 bits, front to back)
+class RenderQueue
+{
+public:
+    RenderQueue() {}
+    RenderQueue(const RenderQueue&) = delete;
+
+    void clear();
+    void push(
+        const Mesh* mesh,
+        const Texture* diffuse_texture,
+        const Texture* normal_map,
+        const glm::mat4& model,
+        const float depth,
+        const uint8_t shader = 0
+    );
+    // Also groups packets into batches, with their transforms laid out in
+    // the same order for upload to an InstanceBuffer
+    void sort();
+    size_t size() const { return packets.size(); }
+
+    const std::vector<DrawBatch>& get_batches() const { return batches; }
+    const std::vector<glm::mat4>& get_transforms() const { return transforms; }
+
+    RenderQueueStats stats;
+
+private:
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t packet;
+    };
+
+    static uint64_t make_key(
+        const uint8_t shader,
+        const uint16_t material,
+        const uint16_t mesh,
+        const float depth
+    );
+
+    std::vector<DrawPacket> packets;
+    std::vector<SortEntry> entries;
+    std::vector<SortEntry> scratch;
+    std::vector<DrawBatch> batches;
+    std::vector<glm::mat4> transforms;
+
+    // Dense per-frame IDs (pointers make for poor keys)
+    struct MaterialKeyHash
+    {
+        size_t operator()(const std::pair<const Texture*, const Texture*>& key) const
+        {
+            return std::hash<const void*>()(key.first) ^ (std::hash<const void*>()(key.second) << 1);
+        }
+    };
+    std::unordered_map<std::pair<const Texture*, const Texture*>, uint16_t, MaterialKeyHash> material_ids;
+    std::unordered_map<const Mesh*, uint16_t> mesh_ids;
+};
@@ -1,5 +1,7 @@
 #pragma once
 #include "render_passes/render_passes.h"
+#include "uniform_buffer.h"
+#include "gpu_profiler.h"
 #include "window.h"
 #include "scene.h"
 #include <string>
@@ -9,7 +11,7 @@
 class Renderer
 {
 public:
-    Renderer(const std::string& title, const int width, const int height, const float render_scale);
+    Renderer(const std::string& title, const int width, const int height, const float render_scale, const bool headless = false);
     ~Renderer();
 
     bool update(Scene& scene);
@@ -23,6 +25,10 @@ private:
     unsigned int render_width() const;
     unsigned int render_height() const;
 
+    // Texture streaming
+    int texture_budget_mb = TEXTURE_BUDGET_MB;
+    void draw_texture_stats_gui();
+
     // Render passes
     GBufferPass             g_buffer_pass;
     LightingPass            lighting_pass;
@@ -35,7 +41,18 @@ private:
     CloudPass               cloud_pass;
     CompositePass           composite_pass;
 
+    // Decides which offscreen views are redrawn each frame
+    ViewScheduler view_scheduler;
+
+    // Per-pass GPU timings
+    GPUProfiler gpu_profiler;
+
+    // Shared per-frame uniforms
+    UniformBuffer frame_uniform_buffer;
+
     // Frame state
-    bool did_bake_shadows = false;
     double last_fps_report_time = 0.0f;
+    double last_frame_time = 0.0f;
+    unsigned int frames_since_purge = 0;
+    std::optional<glm::mat4> previous_view_projection;
 };
\ No newline at end of file
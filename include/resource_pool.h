@@ -0,0 +1,185 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Index into a ResourcePool - the generation lets us tell when the slot it
+// points to has since been freed and reused
+template<typename T>
+struct Handle
+{
+    uint32_t index = 0;
+    uint32_t generation = 0;
+
+    bool operator==(const Handle&) const = default;
+};
+
+template<typename T>
+class ResourcePool
+{
+public:
+    ResourcePool() {}
+    ResourcePool(const ResourcePool&) = delete;
+
+    ~ResourcePool()
+    {
+        for (auto& slot : slots) delete slot.resource;
+        for (auto& pending : pending_destruction) delete pending.resource;
+    }
+
+    Handle<T> insert(T* resource)
+    {
+        uint32_t index;
+        if (free_slots.empty())
+        {
+            index = slots.size();
+            slots.push_back({});
+        }
+        else
+        {
+            index = free_slots.back();
+            free_slots.pop_back();
+        }
+
+        slots[index].resource = resource;
+        slots[index].references = 0;
+        return { index, slots[index].generation };
+    }
+
+    // Returns nullptr for stale handles
+    T* get(const Handle<T> handle) const
+    {
+        if (!is_valid(handle)) return nullptr;
+        return slots[handle.index].resource;
+    }
+
+    bool is_valid(const Handle<T> handle) const
+    {
+        return handle.index < slots.size() &&
+            slots[handle.index].generation == handle.generation &&
+            slots[handle.index].resource != nullptr;
+    }
+
+    void acquire(const Handle<T> handle)
+    {
+        if (is_valid(handle)) ++slots[handle.index].references;
+    }
+
+    // Unreferenced resources stay cached until purge_unused() is called
+    void release(const Handle<T> handle)
+    {
+        if (is_valid(handle) && slots[handle.index].references > 0)
+            --slots[handle.index].references;
+    }
+
+    uint32_t references(const Handle<T> handle) const
+    {
+        return is_valid(handle) ? slots[handle.index].references : 0;
+    }
+
+    // Frees the slots of every unreferenced resource straight away (so their
+    // handles go stale), but only destroys them once frame has finished
+    size_t purge_unused(const uint64_t frame)
+    {
+        size_t purged = 0;
+        for (uint32_t i = 0; i < slots.size(); ++i)
+        {
+            Slot& slot = slots[i];
+            if (!slot.resource || slot.references > 0) continue;
+
+            pending_destruction.push_back({ slot.resource, frame });
+            slot.resource = nullptr;
+            ++slot.generation;
+            free_slots.push_back(i);
+            ++purged;
+        }
+        return purged;
+    }
+
+    // Destroys resources purged before the given frame
+    void collect(const uint64_t frame)
+    {
+        std::erase_if(pending_destruction, [&](const PendingDestruction& pending)
+        {
+            if (pending.frame >= frame) return false;
+            delete pending.resource;
+            return true;
+        });
+    }
+
+    template<typename F>
+    void for_each(F f) const
+    {
+        for (uint32_t i = 0; i < slots.size(); ++i)
+            if (slots[i].resource)
+                f(Handle<T> { i, slots[i].generation }, slots[i].resource);
+    }
+
+private:
+    struct Slot
+    {
+        T* resource = nullptr;
+        uint32_t generation = 0;
+        uint32_t references = 0;
+    };
+
+    struct PendingDestruction
+    {
+        T* resource;
+        uint64_t frame;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> free_slots;
+    std::vector<PendingDestruction> pending_destruction;
+};
+
+// Reference-counted handle - copying it keeps the resource alive, and the pool
+// is reached through a pointer so that refs outliving free_resources() are harmless
+template<typename T>
+class Ref
+{
+public:
+    Ref() {}
+
+    Ref(ResourcePool<T>** _pool, const Handle<T> _handle) : pool(_pool), handle(_handle)
+    {
+        acquire();
+    }
+
+    Ref(const Ref& other) : pool(other.pool), handle(other.handle)
+    {
+        acquire();
+    }
+
+    Ref& operator=(const Ref& other)
+    {
+        if (this == &other) return *this;
+        release();
+        pool = other.pool;
+        handle = other.handle;
+        acquire();
+        return *this;
+    }
+
+    ~Ref()
+    {
+        release();
+    }
+
+    T* get() const
+    {
+        return (pool && *pool) ? (*pool)->get(handle) : nullptr;
+    }
+
+    T* operator->() const { return get(); }
+    T& operator*() const { return *get(); }
+    explicit operator bool() const { return get() != nullptr; }
+
+private:
+    void acquire() { if (pool && *pool) (*pool)->acquire(handle); }
+    void release() { if (pool && *pool) (*pool)->release(handle); }
+
+    ResourcePool<T>** pool = nullptr;
+    Handle<T> handle = {};
+};
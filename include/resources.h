@@ -4,16 +4,31 @@
 #include <optional>
 #include "texture.h"
 #include "mesh.h"
+#include "resource_pool.h"
+#include "instance_buffer.h"
+
+typedef Ref<Texture> TextureRef;
+typedef Ref<Mesh> MeshRef;
 
 struct Material
 {
-    Texture* diffuse_texture;
-    std::optional<Texture*> normal_map;
+    TextureRef diffuse_texture;
+    std::optional<TextureRef> normal_map;
+};
+
+struct TextureStats
+{
+    std::string filename;
+    size_t resident_size;
+    size_t total_size;
+    unsigned int resident_mip;
+    unsigned int requested_mip;
+    unsigned int mip_count;
 };
 
 struct TexturedMesh
 {
-    Mesh* mesh;
+    MeshRef mesh;
     Material material;
 };
 
@@ -21,7 +36,19 @@ void init_resources();
 void free_resources();
 
 std::vector<TexturedMesh> load_assimp_scene(const std::string& filename);
-Texture* get_texture(const std::string& filename, const bool use_nearest_filtering = false);
+TextureRef get_texture(const std::string& filename, const bool use_nearest_filtering = false);
+
+// Resources no longer referenced by anything stay cached until purged (the
+// renderer does so every RESOURCE_PURGE_INTERVAL frames), and are then
+// destroyed by collect_resources() once the current frame is done
+size_t purge_unused_resources();
+void collect_resources();
+
+// Texture streaming - call once per frame after all passes have requested mips
+// (and before collect_resources())
+void stream_textures(const size_t budget, const size_t upload_budget);
+std::vector<TextureStats> get_texture_stats();
 
 extern Mesh* quad_mesh;
 extern Mesh* cube_mesh;
+extern InstanceBuffer* instance_buffer;
@@ -16,7 +16,7 @@ typedef std::shared_ptr<Texture> Skybox;
 struct Sprite
 {
     Transform transform = {};
-    Texture* texture;
+    TextureRef texture;
 
     Sprite(const std::string& filename)
     {
@@ -1,3 +1,4 @@
+#pragma once
 #include <array>
 #include <string>
 #include <vector>
@@ -11,6 +12,24 @@
 #define DEFINE_SHADER_UNIFORM(x) void set_uniform(const std::string& name, x)
 #define NAME get_uniform_location(name)
 
+#define SHADER_UNIFORM_HANDLE(t, x) void Shader::set_uniform(const Uniform<t> uniform, x) const
+#define DEFINE_SHADER_UNIFORM_HANDLE(t, x) void set_uniform(const Uniform<t> uniform, x) const
+#define LOCATION uniform.location
+
+// Uniform location resolved once (when a pass is created) so that setting it
+// each frame needs no string lookups - the type stops mismatched uploads
+template<typename T>
+struct Uniform
+{
+    int location = -1;
+};
+
+// Uniform blocks shared by every shader, and the binding point each is given
+enum UniformBlockBinding
+{
+    FrameBlock = 0
+};
+
 class Shader
 {
 public:
@@ -29,6 +48,11 @@ public:
 
     static std::array<ShaderType, 3> shader_types;
 
+    // Startup stats
+    static double total_load_time;
+    static unsigned int cache_hits;
+    static unsigned int cache_misses;
+
 public:
     Shader(const std::string& filename, const std::vector<ShaderTypeID>& shader_type_ids);
     Shader(const Shader&) = delete;
@@ -44,12 +68,31 @@ public:
     DEFINE_SHADER_UNIFORM(const float value);
     DEFINE_SHADER_UNIFORM(const int value);
 
+    DEFINE_SHADER_UNIFORM_HANDLE(glm::mat4, const glm::mat4& matrix);
+    DEFINE_SHADER_UNIFORM_HANDLE(glm::vec4, const glm::vec4& vector);
+    DEFINE_SHADER_UNIFORM_HANDLE(glm::vec3, const glm::vec3& vector);
+    DEFINE_SHADER_UNIFORM_HANDLE(glm::vec2, const glm::vec2& vector);
+    DEFINE_SHADER_UNIFORM_HANDLE(float, const float value);
+    DEFINE_SHADER_UNIFORM_HANDLE(int, const int value);
+
+    template<typename T>
+    Uniform<T> get_uniform(const std::string& name)
+    {
+        return { get_uniform_location(name) };
+    }
+
 private:
 
     void handle_error(auto f, auto f2, const unsigned int id,
         const unsigned int type, const std::string& error, const std::string& filename);
 
     int get_uniform_location(const std::string& name);
+    void enumerate_uniforms();
+
+    // Program binary cache
+    static std::string get_cache_path(const std::string& filename, const std::string& source);
+    bool load_binary(const std::string& path);
+    void save_binary(const std::string& path) const;
 
     // OpenGL state
     unsigned int program;
@@ -71,11 +114,17 @@ SHADER(GBufferShader,   "g_buffer",     SHADER_NORMAL)
 SHADER(LightingShader,  "lighting",     SHADER_NORMAL)
 SHADER(SSAOShader,      "ssao",         SHADER_NORMAL)
 SHADER(WaterShader,     "water",        SHADER_NORMAL)
+SHADER(DepthPyramidShader,      "depth_pyramid",        { ShaderTypeID::Compute })
 SHADER(QuadShader,      "quad",         SHADER_NORMAL)
 SHADER(ShadowMapShader, "shadow_map",   SHADER_NORMAL)
 SHADER(CompositeShader, "composite",    SHADER_NORMAL)
-SHADER(BlurShader,      "blur",         SHADER_NORMAL)
-SHADER(BloomShader,     "bloom",        SHADER_NORMAL)
+SHADER(BlurShader,      "blur",         { ShaderTypeID::Compute })
+SHADER(BilateralBlurShader,     "bilateral_blur",       SHADER_NORMAL)
+SHADER(BilateralUpsampleShader, "bilateral_upsample",   SHADER_NORMAL)
+SHADER(BloomDownsampleShader,   "bloom_downsample",     SHADER_NORMAL)
+SHADER(BloomUpsampleShader,     "bloom_upsample",       SHADER_NORMAL)
 SHADER(SkyboxShader,    "skybox",       SHADER_NORMAL)
 SHADER(CloudShader,     "cloud",        SHADER_NORMAL)
-SHADER(WorleyShader,    "worley",       { ShaderTypeID::Compute })
+SHADER(CloudReprojectShader,    "cloud_reproject",      SHADER_NORMAL)
+SHADER(CloudShadowShader,       "cloud_shadow",         SHADER_NORMAL)
+SHADER(EVSMShader,      "evsm",         SHADER_NORMAL)
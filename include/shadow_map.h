@@ -0,0 +1,120 @@
+#pragma once
+#include "camera.h"
+#include "framebuffer.h"
+#include "view_scheduler.h"
+#include <glm/glm.hpp>
+#include <array>
+#include <vector>
+#include <memory>
+
+// Limited by how split distances are packed into the frame's uniform block
+constexpr unsigned int max_shadow_cascades = 4;
+
+// From most to least expensive per pixel
+enum class ShadowFilter
+{
+    Poisson = 0,        // 64 Poisson disk taps
+    HardwarePCF = 1,    // 9 bilinear depth-compare taps
+    EVSM = 2            // prefiltered exponential variance, 1 tap
+};
+
+#include "config.h"
+
+// Depth texture array with one layer per cascade, each fitted to a slice of
+// the camera frustum - nearby slices are smaller, so get more texels per unit.
+//
+// With caching on, static casters are drawn into a second array that's only
+// redrawn when a cascade moves, the light moves or static geometry changes;
+// each frame that's copied back and dynamic casters are drawn on top. Each
+// cascade is an offscreen view, so only follows the camera when scheduled -
+// straight away if it's fallen well behind, otherwise when there's time.
+class ShadowMap
+{
+public:
+    ShadowMap(const unsigned int resolution, const unsigned int cascades);
+    ShadowMap(const ShadowMap&) = delete;
+    ~ShadowMap();
+
+    // Fits each cascade, submitting those that have moved to the scheduler -
+    // then the ones it picks take their new fit in apply_scheduled_cascades()
+    void update_cascades(
+        const Camera& camera,
+        const glm::vec3& light_direction,
+        const float width,
+        const float height,
+        ViewScheduler& scheduler
+    );
+    void apply_scheduled_cascades();
+
+    // Binds the cascade's framebuffer (and sets the viewport)
+    void bind_layer(const unsigned int cascade) const;
+    void bind_static_layer(const unsigned int cascade) const;
+    void bind_moments_layer(const unsigned int cascade) const;
+    void bind(const unsigned int unit) const;
+    void bind_compare(const unsigned int unit) const;
+    void unbind_compare(const unsigned int unit) const;
+    void bind_moments(const unsigned int unit) const;
+
+    // Copies cached static depth over the cascade's live layer
+    void restore_static_layer(const unsigned int cascade) const;
+    void invalidate_static();
+
+    unsigned int resolution;
+    unsigned int cascades;
+
+    // Light-space matrix and view-space far distance of each cascade
+    std::array<glm::mat4, max_shadow_cascades> matrices = {};
+    std::array<float, max_shadow_cascades> splits = {};
+
+    // 0 gives evenly spaced splits, 1 logarithmically spaced ones
+    float split_lambda = SHADOW_SPLIT_LAMBDA;
+    float distance = SHADOW_DISTANCE;
+
+    bool caching = SHADOW_CACHING;
+    std::array<bool, max_shadow_cascades> static_dirty = {};
+    std::array<bool, max_shadow_cascades> had_dynamic_casters = {};
+    std::vector<std::unique_ptr<OffscreenView>> views;
+
+    // EVSM moments are half resolution (they're blurred anyway), and only
+    // regenerated for layers whose depth changed
+    ShadowFilter filter = SHADOW_FILTER;
+    unsigned int moments_resolution;
+    std::array<bool, max_shadow_cascades> moments_dirty = {};
+    Framebuffer moments_scratch;
+
+private:
+    struct Fit
+    {
+        glm::mat4 matrix;
+        glm::vec3 centre;
+        float radius;
+    };
+
+    Fit fit_cascade(
+        const Camera& camera,
+        const glm::vec3& light_direction,
+        const float width,
+        const float height,
+        const float near,
+        const float far
+    ) const;
+
+    void create_layers(unsigned int& array, std::vector<unsigned int>& layer_framebuffers);
+
+    void create_moments();
+
+    unsigned int texture;
+    unsigned int static_texture;
+    unsigned int moments_texture;
+    unsigned int compare_sampler;
+    std::vector<unsigned int> framebuffers;
+    std::vector<unsigned int> static_framebuffers;
+    std::vector<unsigned int> moments_framebuffers;
+
+    // Latest fits, and what the current ones were fitted around - moving too
+    // far from those makes an update urgent
+    std::array<Fit, max_shadow_cascades> fits = {};
+    std::array<glm::vec3, max_shadow_cascades> centres = {};
+    std::array<glm::vec3, max_shadow_cascades> light_directions = {};
+    glm::vec3 fitted_light_direction = {};
+};
@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <array>
+#include <vector>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
@@ -9,7 +10,8 @@ class Texture
 public:
     Texture(
         const std::string& filename,
-        const bool use_nearest_filtering = false
+        const bool use_nearest_filtering = false,
+        const bool use_streaming = false
     );
 
     // For cubemaps
@@ -33,11 +35,52 @@ public:
     void clamp(const glm::vec4& colour, const bool to_border = true) const;
     void set_as_texture_atlas(const int max_mipmap_level) const;
 
+    // Gives an FBO-style texture a full (uninitialised) mip chain, to be
+    // filled in by hand - e.g. one level at a time from a compute shader
+    unsigned int allocate_mips() const;
+
     void bind(const unsigned int unit = 0) const;
-    void bind_image(const unsigned int internal_format, const unsigned int access) const;
+    void bind_image(const unsigned int internal_format, const unsigned int access, const unsigned int unit = 0, const unsigned int level = 0) const;
+    unsigned int get_internal_format() const;
     void unbind() const;
 
+    // Mip streaming - only textures loaded from disk with use_streaming set
+    // keep a CPU copy of their mip chain and can have their finer mips
+    // uploaded or evicted at runtime
+    bool is_streamed() const;
+    unsigned int mip_count() const;
+    void request_screen_size(const float pixels);
+    size_t next_mip_size() const;
+    size_t stream_in();
+    size_t evict();
+    size_t resident_size() const;
+    size_t total_size() const;
+
     // OpenGL state
     unsigned int texture_id;
     unsigned int texture_type  = GL_TEXTURE_2D;
-};
\ No newline at end of file
+
+    // Streaming state (finest mip on GPU, finest mip asked for this frame)
+    unsigned int resident_mip = 0;
+    unsigned int requested_mip = 0;
+    unsigned int base_resident_mip = 0;
+    bool used_this_frame = false;
+    unsigned long long last_used_frame = 0;
+
+private:
+    struct MipLevel
+    {
+        unsigned int width;
+        unsigned int height;
+        std::vector<unsigned char> pixels;
+    };
+
+    void upload_mip(const unsigned int level) const;
+
+    std::vector<MipLevel> mips;
+    unsigned int width = 0;
+    unsigned int height = 0;
+    unsigned int format = GL_RGBA;
+    unsigned int internal_format = GL_RGBA8;
+    unsigned int type = GL_UNSIGNED_BYTE;
+};
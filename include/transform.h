@@ -1,37 +1,52 @@
 #pragma once
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstdint>
 
+// Handle to a node in one global transform hierarchy. Nodes (and their world
+// matrices) live contiguously, and a world matrix is only rebuilt when its
+// node or one of its ancestors has changed - so static objects cost next to
+// nothing. Copying a transform makes a new node with the same local values.
 class Transform
 {
 public:
 
+    // Rotation in Euler angles (degrees), applied X then Y then Z
     Transform(const glm::vec3 position = {}, const glm::vec3 rotation = {},
-        const glm::vec3 scale = { 1.0f, 1.0f, 1.0f })
-    {
-        this->position = position;
-        this->rotation = rotation;
-        this->scale =scale;
-    }
-
-    glm::mat4 matrix() const
-    {
-        glm::mat4 matrix = glm::mat4(1.0f);
-
-        // Translation
-        matrix = glm::translate(matrix, position);
-
-        // Rotation
-        matrix = glm::rotate(matrix, glm::radians(rotation.x), glm::vec3(1, 0, 0));
-        matrix = glm::rotate(matrix, glm::radians(rotation.y), glm::vec3(0, 1, 0));
-        matrix = glm::rotate(matrix, glm::radians(rotation.z), glm::vec3(0, 0, 1));
-
-        // Scale
-        matrix = glm::scale(matrix, { scale.x, scale.y, scale.z });
-        return matrix;
-    }
-
-    glm::vec3 position;
-    glm::vec3 rotation;
-    glm::vec3 scale;
+        const glm::vec3 scale = { 1.0f, 1.0f, 1.0f });
+    Transform(const Transform& other);
+
+    // Moved-from transforms can only be assigned to or destroyed - anything
+    // else throws
+    Transform(Transform&& other) noexcept;
+    Transform& operator=(const Transform& other);
+    Transform& operator=(Transform&& other) noexcept;
+    ~Transform();
+
+    // Local (parent-relative) values
+    glm::vec3 get_position() const;
+    glm::quat get_rotation() const;
+    glm::vec3 get_scale() const;
+    void set_position(const glm::vec3& position);
+    void set_rotation(const glm::quat& rotation);
+    void set_rotation(const glm::vec3& euler_degrees);
+    void set_scale(const glm::vec3& scale);
+
+    // Pass nullptr to detach; children of a destroyed parent become roots.
+    // Throws if parent is this transform or one of its descendants
+    void set_parent(const Transform* parent);
+
+    // World matrix
+    glm::mat4 matrix() const;
+
+    // Changes whenever the world matrix does
+    uint32_t version() const;
+
+private:
+    uint32_t node;
 };
+
+// Brings every world matrix up to date in one go - call once per frame
+// before rendering (matrix() still works without it, just less efficiently)
+void update_transforms();
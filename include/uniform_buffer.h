@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+
+class UniformBuffer
+{
+public:
+    UniformBuffer(const size_t size, const unsigned int binding);
+    UniformBuffer(const UniformBuffer&) = delete;
+    ~UniformBuffer();
+
+    void update(const void* data) const;
+
+private:
+    unsigned int ubo;
+    size_t size;
+};
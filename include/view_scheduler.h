@@ -0,0 +1,74 @@
+#pragma once
+#include "config.h"
+#include <string>
+#include <vector>
+#include <array>
+
+// Something drawn off screen that needn't be redrawn every frame - shadow
+// cascades, cloud shadows, probes, etc. Each frame its owner says whether it's
+// gone stale (and whether that can't wait), and then only redraws it if the
+// ViewScheduler picked it.
+class OffscreenView
+{
+public:
+    OffscreenView(const std::string& name, const float priority);
+    OffscreenView(const OffscreenView&) = delete;
+    ~OffscreenView();
+
+    // Wraps the GL work of an update so that its cost can be measured (as
+    // timer queries can't nest, only one view may be updating at a time)
+    void begin_update();
+    void end_update();
+
+    bool is_scheduled() const;
+
+    std::string name;
+
+    // Higher priorities catch up sooner when there isn't time for everything
+    float priority;
+
+    struct
+    {
+        unsigned int updates = 0;
+        unsigned int urgent_updates = 0;
+        unsigned int deferrals = 0;     // Frames spent stale but not picked
+        unsigned int staleness = 0;     // Frames since it went stale
+        unsigned int max_staleness = 0;
+        float cost_ms = 0.0f;           // Running average of measured GPU time
+    } stats;
+
+private:
+    friend class ViewScheduler;
+    void collect_timings();
+
+    bool stale = false;
+    bool urgent = false;
+    bool scheduled = false;
+    bool timing = false;
+
+    // Read back a few frames late, so as not to stall
+    static constexpr unsigned int query_count = 4;
+    std::array<unsigned int, query_count> queries = {};
+    std::array<bool, query_count> pending = {};
+    unsigned int next_query = 0;
+};
+
+// Spreads offscreen view updates over frames within a GPU time budget, so that
+// frame time doesn't grow with the number of views. Urgent views always update;
+// the rest take turns - most overdue (staleness times priority) first - until
+// the budget's spent. At least one is always updated, so none starve.
+class ViewScheduler
+{
+public:
+    // Every view should be submitted each frame (stale or not) before schedule()
+    void submit(OffscreenView& view, const bool stale, const bool urgent = false);
+    void schedule();
+    void draw_gui();
+
+    float budget_ms = OFFSCREEN_VIEW_BUDGET_MS;
+
+private:
+    std::vector<OffscreenView*> submitted;
+    std::vector<OffscreenView*> views;
+    float planned_ms = 0.0f;
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <chrono>
 #include "glad/glad.h"
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -7,11 +8,17 @@
 class Window
 {
 public:
-    Window(const std::string& name, const int width, const int height);
+    // Headless windows have no window (or display) at all - the context comes
+    // from EGL, and everything is drawn into an offscreen framebuffer instead
+    Window(const std::string& name, const int width, const int height, const bool headless = false);
     ~Window();
 
     bool update();
     void set_title(const std::string& title) const;
+    double get_time() const;
+
+    // Writes what was last drawn to output_framebuffer as a binary PPM
+    void save_screenshot(const std::string& filename) const;
 
     // I/O
     bool get_key(const int key, const bool repeat = true) const;
@@ -24,13 +31,27 @@ public:
     int height;
     int framebuffer_width;
     int framebuffer_height;
-    GLFWwindow* window;
+    const bool headless;
+    GLFWwindow* window = nullptr;
+
+    // Where the final image goes (0, the default framebuffer, unless headless)
+    unsigned int output_framebuffer = 0;
 
 private:
     void init_glfw(const std::string& name);
+    void init_egl();
     void init_glad();
+    void init_output_framebuffer();
     void enable_debugging();
 
     bool cached_mouse_buttons[3] = {};
     bool cached_keyboard_buttons[GLFW_KEY_LAST + 1] = {};
-};
\ No newline at end of file
+
+    // EGLDisplay, EGLContext and EGLSurface are all pointers - kept opaque so
+    // the EGL headers (and their platform baggage) stay out of here
+    void* egl_display = nullptr;
+    void* egl_context = nullptr;
+    void* egl_surface = nullptr;
+    unsigned int output_renderbuffers[2] = {};
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+};
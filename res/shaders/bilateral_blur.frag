@@ -0,0 +1,47 @@
+#version 330 core
+
+in vec2 out_texture_coord;
+
+// Gaussian blur that doesn't bleed across depth discontinuities
+uniform sampler2D image;
+uniform sampler2D depth;
+uniform bool horizontal;
+uniform float depth_sharpness = 1.0;
+
+#include "frame.glsl"
+
+const float weights[5] = float[] (0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216);
+
+layout (location = 0) out float frag_colour;
+
+float linear_depth(vec2 uv)
+{
+    float z = texture(depth, uv).r * 2.0 - 1.0;
+    return 2.0 * screen.z * screen.w / (screen.w + screen.z - z * (screen.w - screen.z));
+}
+
+void main()
+{
+    vec2 uv = out_texture_coord;
+    vec2 texel_size = 1.0 / textureSize(image, 0);
+    vec2 direction = horizontal ? vec2(texel_size.x, 0.0) : vec2(0.0, texel_size.y);
+    float centre_depth = linear_depth(uv);
+
+    float result = texture(image, uv).r * weights[0];
+    float total_weight = weights[0];
+
+    for (int i = -4; i <= 4; ++i)
+    {
+        if (i == 0) continue;
+
+        // Relative depth difference, so it works the same near and far
+        vec2 sample_uv = uv + direction * i;
+        float difference = abs(linear_depth(sample_uv) - centre_depth) / centre_depth;
+        float weight = weights[abs(i)] * exp(-difference * difference * depth_sharpness * 1000.0);
+
+        result += texture(image, sample_uv).r * weight;
+        total_weight += weight;
+    }
+
+    frag_colour = result / total_weight;
+}
@@ -0,0 +1,49 @@
+#version 330 core
+
+in vec2 out_texture_coord;
+
+// Joint bilateral upsample - bilinear, but with each low-resolution texel
+// weighted by how close its depth is to the full-resolution pixel's
+uniform sampler2D image;
+uniform sampler2D depth;
+
+#include "frame.glsl"
+
+layout (location = 0) out float frag_colour;
+
+float linear_depth(vec2 uv)
+{
+    float z = texture(depth, uv).r * 2.0 - 1.0;
+    return 2.0 * screen.z * screen.w / (screen.w + screen.z - z * (screen.w - screen.z));
+}
+
+void main()
+{
+    vec2 size = textureSize(image, 0);
+    vec2 position = out_texture_coord * size - 0.5;
+    vec2 base = floor(position);
+    vec2 f = position - base;
+    float centre_depth = linear_depth(out_texture_coord);
+
+    float bilinear[4] = float[] ((1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y), (1.0 - f.x) * f.y, f.x * f.y);
+    vec2 offsets[4] = vec2[] (vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(0.0, 1.0), vec2(1.0, 1.0));
+
+    float result = 0.0;
+    float total_weight = 0.0;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        vec2 texel = clamp(base + offsets[i], vec2(0.0), size - 1.0);
+        vec2 uv = (texel + 0.5) / size;
+        float value = texelFetch(image, ivec2(texel), 0).r;
+
+        float difference = abs(linear_depth(uv) - centre_depth) / centre_depth;
+        // (never quite zero, so an edge with nothing similar nearby still
+        // falls back to plain bilinear)
+        float weight = bilinear[i] / (difference * 100.0 + 0.001);
+        result += value * weight;
+        total_weight += weight;
+    }
+
+    frag_colour = result / max(total_weight, 1e-5);
+}
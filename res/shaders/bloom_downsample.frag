@@ -0,0 +1,68 @@
+#version 330 core
+
+in vec2 out_texture_coord;
+
+// 13-tap downsample from "Next Generation Post Processing in Call of Duty:
+// Advanced Warfare" - overlapping 2x2 boxes, so nothing aliases as it shrinks
+uniform sampler2D image;
+
+// First level only - bright parts of the lit image, scaled down as every
+// level of the chain is added back together
+uniform bool prefilter;
+uniform float threshold;
+uniform float intensity;
+
+layout (location = 0) out vec4 frag_colour;
+
+float luminance(vec3 colour)
+{
+    return dot(colour, vec3(0.2126, 0.7152, 0.0722));
+}
+
+vec3 sample_image(vec2 uv)
+{
+    vec3 colour = texture(image, uv).rgb;
+    if (prefilter && luminance(colour) <= threshold) return vec3(0.0);
+    return colour;
+}
+
+// "Karis average" - weights each box by its inverse brightness, which stops
+// single very bright pixels from flickering in and out
+vec3 box(vec3 a, vec3 b, vec3 c, vec3 d, inout float total_weight, float weight)
+{
+    vec3 average = (a + b + c + d) * 0.25;
+    if (prefilter) weight /= 1.0 + luminance(average);
+    total_weight += weight;
+    return average * weight;
+}
+
+void main()
+{
+    vec2 uv = out_texture_coord;
+    vec2 texel = 1.0 / textureSize(image, 0);
+
+    vec3 a = sample_image(uv + texel * vec2(-2.0,  2.0));
+    vec3 b = sample_image(uv + texel * vec2( 0.0,  2.0));
+    vec3 c = sample_image(uv + texel * vec2( 2.0,  2.0));
+    vec3 d = sample_image(uv + texel * vec2(-2.0,  0.0));
+    vec3 e = sample_image(uv);
+    vec3 f = sample_image(uv + texel * vec2( 2.0,  0.0));
+    vec3 g = sample_image(uv + texel * vec2(-2.0, -2.0));
+    vec3 h = sample_image(uv + texel * vec2( 0.0, -2.0));
+    vec3 i = sample_image(uv + texel * vec2( 2.0, -2.0));
+    vec3 j = sample_image(uv + texel * vec2(-1.0,  1.0));
+    vec3 k = sample_image(uv + texel * vec2( 1.0,  1.0));
+    vec3 l = sample_image(uv + texel * vec2(-1.0, -1.0));
+    vec3 m = sample_image(uv + texel * vec2( 1.0, -1.0));
+
+    float total_weight = 0.0;
+    vec3 result = box(j, k, l, m, total_weight, 0.5);
+    result += box(a, b, d, e, total_weight, 0.125);
+    result += box(b, c, e, f, total_weight, 0.125);
+    result += box(d, e, g, h, total_weight, 0.125);
+    result += box(e, f, h, i, total_weight, 0.125);
+    result /= total_weight;
+
+    if (prefilter) result *= intensity;
+    frag_colour = vec4(result, 1.0);
+}
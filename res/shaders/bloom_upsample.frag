@@ -0,0 +1,28 @@
+#version 330 core
+
+in vec2 out_texture_coord;
+
+// 3x3 tent filter over the next level down, added (by blending) on top of
+// the current level
+uniform sampler2D image;
+uniform float radius;
+
+layout (location = 0) out vec4 frag_colour;
+
+void main()
+{
+    vec2 uv = out_texture_coord;
+    vec2 offset = radius / textureSize(image, 0);
+
+    vec3 result = texture(image, uv).rgb * 4.0;
+    result += texture(image, uv + vec2(-offset.x, 0.0)).rgb * 2.0;
+    result += texture(image, uv + vec2( offset.x, 0.0)).rgb * 2.0;
+    result += texture(image, uv + vec2(0.0, -offset.y)).rgb * 2.0;
+    result += texture(image, uv + vec2(0.0,  offset.y)).rgb * 2.0;
+    result += texture(image, uv + vec2(-offset.x, -offset.y)).rgb;
+    result += texture(image, uv + vec2( offset.x, -offset.y)).rgb;
+    result += texture(image, uv + vec2(-offset.x,  offset.y)).rgb;
+    result += texture(image, uv + vec2( offset.x,  offset.y)).rgb;
+
+    frag_colour = vec4(result / 16.0, 1.0);
+}
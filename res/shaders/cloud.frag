@@ -2,26 +2,19 @@
 #define M_PI 3.14159265359
 
 // Scene info
-uniform mat4 inverse_view_projection;
-uniform vec3 camera_position;
-uniform vec3 bounds_min;
-uniform vec3 bounds_max;
+#include "frame.glsl"
+#include "cloud_bounds.glsl"
 uniform vec2 screen_size;
-uniform float z_near;
-uniform float z_far;
-uniform vec3 light_colour;
 
-// Noise
-uniform sampler3D noise_map;
-uniform sampler3D detail_map;
-uniform sampler2D depth_map;
-uniform float offset;
+// Only one pixel in each block is traced per frame (the rest are reprojected
+// from previous frames by cloud_reproject.frag)
+uniform vec2 trace_offset;
+uniform float trace_block;
+uniform float jitter;
 
-// Scattering settings
-uniform float scale = 0.2;
-uniform float detail_scale = 1.2;
-uniform float density = 10;
-uniform float threshold = 0.75;
+// Noise and scattering settings
+#include "cloud_density.glsl"
+uniform sampler2D depth_map;
 uniform float brightness = 8.0;
 
 // Quality settings
@@ -29,56 +22,22 @@ uniform int steps = 256;
 
 layout (location = 0) out vec4 frag_colour;
 
-vec2 get_ray_distance_to_box(vec3 position, vec3 direction)
-{
-    vec3 t0 = (bounds_min - position) / direction;
-    vec3 t1 = (bounds_max - position) / direction;
-    vec3 t_min = min(t0, t1);
-    vec3 t_max = max(t0, t1);
-
-    float distance_a = max(max(t_min.x, t_min.y), t_min.z);
-    float distance_b = min(t_max.x, min(t_max.y, t_max.z));
-
-    float distance_to = max(0, distance_a);
-    float distance_inside = max(0, distance_b - distance_to);
-    return vec2(distance_to, distance_inside);
-}
-
-float get_density(vec3 position)
-{
-    // Sample main texture
-    vec3 texture_pos = (position + offset) * 0.01 * scale;
-    float sample = texture(noise_map, texture_pos).r;
-    float d = max(0, sample - threshold) * density;
-
-    // Fade at edges
-    const float fade_distance = 50;
-    float edge_distance_x = min(fade_distance, min(position.x - bounds_min.x, bounds_max.x - position.x));
-    float edge_distance_y = min(fade_distance, min(position.y - bounds_min.y, bounds_max.y - position.y));
-    float edge_distance_z = min(fade_distance, min(position.z - bounds_min.z, bounds_max.z - position.z));
-    float weight = min(edge_distance_x, min(edge_distance_y, edge_distance_z)) / fade_distance;
-    d *= weight;
-
-    // Add detailed noise
-    float detail = texture(detail_map, (texture_pos + offset * 0.001) * detail_scale).r;
-    d -= detail * (1-d);
-
-    return min(max(d, 0), 1);
-}
-
 float linearise_depth(float d)
 {
+    float z_near = screen.z;
+    float z_far = screen.w;
     return z_near * z_far / (z_far + d * (z_near - z_far));
 }
 
 void main()
 {
     // Figure out ray direction
-    vec2 screen_space = gl_FragCoord.xy / screen_size;
+    vec2 pixel = floor(gl_FragCoord.xy) * trace_block + trace_offset + 0.5;
+    vec2 screen_space = pixel / screen_size;
     vec4 frag_position = vec4(screen_space * 2.0 - 1.0, 1.0, 1.0);
     vec4 frag_direction = inverse_view_projection * frag_position;
 
-    vec3 ray_origin = camera_position;
+    vec3 ray_origin = camera_position.xyz;
     vec3 ray_direction = normalize(frag_direction.xyz);
 
     // Sample depth map
@@ -90,25 +49,67 @@ void main()
     float distance_to = ray_info.x;
     float distance_inside = ray_info.y;
 
-    float distance_travelled = 0;
-    float step_size = distance_inside / steps;
+    // Start a random fraction of a step in, so that banding averages out over frames
+    float base_step = distance_inside / steps;
+    float noise = fract(sin(dot(pixel + jitter, vec2(12.9898, 78.233))) * 43758.5453);
+    float distance_travelled = base_step * noise;
     float max_distance = min(depth - distance_to, distance_inside);
 
     // Perform ray march along intersection to get average density
     float total_density = 0;
     float light_energy = 0;
 
+    // Empty space is crossed in coarse steps - on finding cloud we back up and
+    // take fine ones, until there's been nothing for a while
+    const float coarse_multiplier = 4.0;
+    const int empty_steps_before_coarse = 8;
+    const float min_transmittance = 0.01;
+    bool coarse = false;
+    bool last_step_coarse = false;
+    int empty_steps = 0;
+
     while (distance_travelled < max_distance)
     {
         vec3 ray_position = ray_origin + ray_direction * (distance_to + distance_travelled);
 
         // Sample density
         float density = get_density(ray_position);
+        if (coarse && density > 0)
+        {
+            coarse = false;
+            empty_steps = 0;
+            if (last_step_coarse)
+            {
+                distance_travelled -= base_step * coarse_multiplier;
+                light_energy -= coarse_multiplier;
+                last_step_coarse = false;
+                continue;
+            }
+        }
+
+        float step_size = coarse ? base_step * coarse_multiplier : base_step;
         total_density += density * step_size;
         distance_travelled += step_size;
-
-        // Sample light
-        light_energy += exp(-density);
+        last_step_coarse = coarse;
+
+        // Sample light (weighted by how many fine steps this one stands in for)
+        light_energy += exp(-density) * (step_size / base_step);
+
+        // Hardly any light gets through, so the rest of the ray can't be seen -
+        // but every step still adds to the light, so estimate what's left
+        if (exp(-total_density) < min_transmittance)
+        {
+            float steps_taken = distance_travelled / base_step;
+            float steps_left = (max_distance - distance_travelled) / base_step;
+            light_energy += steps_left * light_energy / max(steps_taken, 1.0);
+            break;
+        }
+
+        if (!coarse)
+        {
+            empty_steps = density > 0 ? 0 : empty_steps + 1;
+            coarse = empty_steps >= empty_steps_before_coarse;
+        }
     }
 
     float transmittance = exp(-total_density);
@@ -118,7 +119,7 @@ void main()
     light_energy += silver_lining * 100;
     light_energy /= steps;
 
-    vec4 colour = vec4(1, 1, 1, 1) * light_energy * 0.1 * brightness * vec4(light_colour, 1.0);
+    vec4 colour = vec4(1, 1, 1, 1) * light_energy * 0.1 * brightness * vec4(sun_colour.rgb, 1.0);
     frag_colour = colour;
     frag_colour.a = transmittance;
 }
@@ -1,9 +1,8 @@
 #version 330 core
 
 layout (location = 0) in vec3 pos;
-uniform mat4 mvp;
 
 void main()
 {
-    gl_Position = mvp * vec4(pos, 1.0);
+    gl_Position = vec4(pos, 1.0);
 }
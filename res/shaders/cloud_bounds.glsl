@@ -0,0 +1,18 @@
+// Box the clouds live in (it follows the camera)
+uniform vec3 bounds_min;
+uniform vec3 bounds_max;
+
+vec2 get_ray_distance_to_box(vec3 position, vec3 direction)
+{
+    vec3 t0 = (bounds_min - position) / direction;
+    vec3 t1 = (bounds_max - position) / direction;
+    vec3 t_min = min(t0, t1);
+    vec3 t_max = max(t0, t1);
+
+    float distance_a = max(max(t_min.x, t_min.y), t_min.z);
+    float distance_b = min(t_max.x, min(t_max.y, t_max.z));
+
+    float distance_to = max(0, distance_a);
+    float distance_inside = max(0, distance_b - distance_to);
+    return vec2(distance_to, distance_inside);
+}
@@ -0,0 +1,31 @@
+// Density of the cloud layer at a point - include after cloud_bounds.glsl
+uniform sampler3D noise_map;
+uniform sampler3D detail_map;
+uniform float offset;
+
+uniform float scale = 0.2;
+uniform float detail_scale = 1.2;
+uniform float density = 10;
+uniform float threshold = 0.75;
+
+float get_density(vec3 position)
+{
+    // Sample main texture
+    vec3 texture_pos = (position + offset) * 0.01 * scale;
+    float sample = texture(noise_map, texture_pos).r;
+    float d = max(0, sample - threshold) * density;
+
+    // Fade at edges
+    const float fade_distance = 50;
+    float edge_distance_x = min(fade_distance, min(position.x - bounds_min.x, bounds_max.x - position.x));
+    float edge_distance_y = min(fade_distance, min(position.y - bounds_min.y, bounds_max.y - position.y));
+    float edge_distance_z = min(fade_distance, min(position.z - bounds_min.z, bounds_max.z - position.z));
+    float weight = min(edge_distance_x, min(edge_distance_y, edge_distance_z)) / fade_distance;
+    d *= weight;
+
+    // Add detailed noise
+    float detail = texture(detail_map, (texture_pos + offset * 0.001) * detail_scale).r;
+    d -= detail * (1-d);
+
+    return min(max(d, 0), 1);
+}
@@ -0,0 +1,68 @@
+#version 330 core
+
+// Fills in the pixels that weren't traced this frame from where the clouds
+// were last frame, held within the range of the nearby traced pixels so that
+// stale history (i.e. from disocclusion) can't linger
+
+#include "frame.glsl"
+#include "cloud_bounds.glsl"
+
+uniform sampler2D trace;
+uniform sampler2D history;
+uniform vec2 screen_size;
+uniform vec2 trace_offset;
+uniform float trace_block;
+uniform bool history_valid;
+
+layout (location = 0) out vec4 frag_colour;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 block = pixel / int(trace_block);
+    ivec2 trace_size = textureSize(trace, 0);
+    vec2 uv = gl_FragCoord.xy / screen_size;
+
+    // Traced this very frame
+    if (pixel - block * int(trace_block) == ivec2(trace_offset))
+    {
+        frag_colour = texelFetch(trace, block, 0);
+        return;
+    }
+
+    // Otherwise upsampled, if there's nothing better
+    vec4 current = texture(trace, uv);
+
+    // Find where this pixel was last frame - clouds have no depth of their own,
+    // so take where the ray enters them (or partway in, if we're inside)
+    vec4 direction = inverse_view_projection * vec4(uv * 2.0 - 1.0, 1.0, 1.0);
+    vec3 ray_direction = normalize(direction.xyz);
+    vec2 ray_info = get_ray_distance_to_box(camera_position.xyz, ray_direction);
+    float distance = ray_info.x > 0.0 ? ray_info.x : ray_info.y * 0.5;
+    vec3 position = camera_position.xyz + ray_direction * max(distance, 1.0);
+
+    vec4 previous = previous_view_projection * vec4(position, 1.0);
+    vec2 previous_uv = previous.xy / previous.w * 0.5 + 0.5;
+    bool on_screen = previous.w > 0.0 && all(greaterThanEqual(previous_uv, vec2(0.0))) && all(lessThanEqual(previous_uv, vec2(1.0)));
+
+    if (!history_valid || !on_screen)
+    {
+        frag_colour = current;
+        return;
+    }
+
+    // Clamp to the neighbourhood of traced pixels
+    vec4 minimum = vec4(1e10);
+    vec4 maximum = vec4(-1e10);
+    for (int x = -1; x <= 1; ++x)
+    {
+        for (int y = -1; y <= 1; ++y)
+        {
+            vec4 neighbour = texelFetch(trace, clamp(block + ivec2(x, y), ivec2(0), trace_size - 1), 0);
+            minimum = min(minimum, neighbour);
+            maximum = max(maximum, neighbour);
+        }
+    }
+
+    frag_colour = clamp(texture(history, previous_uv), minimum, maximum);
+}
@@ -0,0 +1,34 @@
+#version 330 core
+
+// How much sunlight gets through the cloud layer - each texel marches from a
+// point on the base of the layer towards the sun, through to the top
+
+#include "frame.glsl"
+#include "cloud_bounds.glsl"
+#include "cloud_density.glsl"
+#include "cloud_shadow.glsl"
+
+uniform vec2 resolution;
+uniform float shadow_density;
+
+layout (location = 0) out float frag_colour;
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / resolution;
+    vec2 position = cloud_shadow_area.xy + uv / cloud_shadow_area.z;
+
+    vec3 direction = get_cloud_shadow_direction();
+    float length = (bounds_max.y - bounds_min.y) / direction.y;
+
+    const int steps = 16;
+    float step_size = length / steps;
+    float total_density = 0.0;
+    for (int i = 0; i < steps; ++i)
+    {
+        vec3 sample_position = vec3(position.x, bounds_min.y, position.y) + direction * (i + 0.5) * step_size;
+        total_density += get_density(sample_position) * step_size;
+    }
+
+    frag_colour = exp(-total_density * shadow_density);
+}
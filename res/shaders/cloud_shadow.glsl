@@ -0,0 +1,18 @@
+// Cloud shadows, rendered once a frame by CloudPass - include after frame.glsl
+
+// Clamped so low suns don't stretch the shadows out forever
+vec3 get_cloud_shadow_direction()
+{
+    vec3 direction = normalize(sun_position.xyz);
+    return normalize(vec3(direction.x, max(direction.y, 0.2), direction.z));
+}
+
+// Follows the sun up to the base of the cloud layer, so the one 2D texture
+// works at any height
+float get_cloud_shadow(sampler2D cloud_shadow_map, vec3 world_position)
+{
+    vec3 direction = get_cloud_shadow_direction();
+    float distance = max(cloud_shadow_area.w - world_position.y, 0.0) / direction.y;
+    vec2 position = world_position.xz + direction.xz * distance;
+    return texture(cloud_shadow_map, (position - cloud_shadow_area.xy) * cloud_shadow_area.z).r;
+}
@@ -0,0 +1,54 @@
+#version 330 core
+
+in vec2 out_texture_coord;
+
+// First pass turns a cascade's depth into moments, blurring horizontally; the
+// second blurs those vertically
+uniform sampler2DArray depth_map;
+uniform sampler2D moments;
+uniform int layer;
+uniform bool horizontal;
+
+const float weights[5] = float[] (0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216);
+
+// Kept low enough for 16-bit floats - must match lighting.frag
+const vec2 exponents = vec2(5.0, 5.0);
+
+layout (location = 0) out vec4 frag_colour;
+
+vec4 get_moments(vec2 uv)
+{
+    float depth = texture(depth_map, vec3(uv, layer)).r * 2.0 - 1.0;
+    float positive = exp(exponents.x * depth);
+    float negative = -exp(-exponents.y * depth);
+    return vec4(positive, positive * positive, negative, negative * negative);
+}
+
+void main()
+{
+    vec2 uv = out_texture_coord;
+
+    if (horizontal)
+    {
+        // Step by the output's (half-resolution) texels
+        vec2 texel_size = 2.0 / textureSize(depth_map, 0).xy;
+        vec4 result = get_moments(uv) * weights[0];
+        for (int i = 1; i < 5; ++i)
+        {
+            result += get_moments(uv + vec2(texel_size.x * i, 0.0)) * weights[i];
+            result += get_moments(uv - vec2(texel_size.x * i, 0.0)) * weights[i];
+        }
+        frag_colour = result;
+    }
+    else
+    {
+        vec2 texel_size = 1.0 / textureSize(moments, 0);
+        vec4 result = texture(moments, uv) * weights[0];
+        for (int i = 1; i < 5; ++i)
+        {
+            result += texture(moments, uv + vec2(0.0, texel_size.y * i)) * weights[i];
+            result += texture(moments, uv - vec2(0.0, texel_size.y * i)) * weights[i];
+        }
+        frag_colour = result;
+    }
+}
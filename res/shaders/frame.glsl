@@ -0,0 +1,17 @@
+// Per-frame data shared by every pass - must match FrameUniforms in render_passes.h
+layout (std140) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    mat4 inverse_view_projection;
+    mat4 previous_view_projection; // for reprojecting last frame
+    mat4 lightspace[4]; // per cascade
+    vec4 camera_position;
+    vec4 sun_position;
+    vec4 sun_colour;
+    vec4 screen; // width, height, z_near, z_far
+    vec4 cascade_splits; // view-space far distance of each cascade
+    vec4 shadow_settings; // cascade count, filter, unused, unused
+    vec4 cloud_shadow_area; // min x, min z, 1 / size, height of the cloud base
+};
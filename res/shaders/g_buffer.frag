@@ -1,6 +1,5 @@
 #version 330 core
 
-in vec4 out_position;
 in vec3 out_normal;
 in vec2 out_texture_coord;
 in mat3 out_tbn;
@@ -9,9 +8,12 @@ uniform sampler2D diffuse_map;
 uniform sampler2D normal_map;
 uniform bool has_normal_map;
 
-layout (location = 0) out vec3 g_albedo;
-layout (location = 1) out vec3 g_normal;
-layout (location = 2) out vec3 g_position;
+#include "frame.glsl"
+#include "g_buffer.glsl"
+
+// Position is reconstructed from depth
+layout (location = 0) out vec4 g_albedo;
+layout (location = 1) out vec2 g_normal;
 
 void main()
 {
@@ -30,7 +32,6 @@ void main()
     vec4 colour = texture(diffuse_map, out_texture_coord);
     if (colour.a < 0.5) discard;
 
-    g_albedo = colour.xyz;
-    g_normal = normal;
-    g_position = out_position.xyz;
+    g_albedo = vec4(colour.xyz, 1.0);
+    g_normal = encode_normal(normal);
 }
@@ -0,0 +1,33 @@
+// Packing shared by everything that reads or writes the G-buffer - include
+// after frame.glsl
+
+// Octahedral encoding - folds the unit sphere onto a square, so two (16-bit)
+// channels are enough for a normal
+vec2 sign_not_zero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 encode_normal(vec3 normal)
+{
+    vec2 encoded = normal.xy / (abs(normal.x) + abs(normal.y) + abs(normal.z));
+    if (normal.z < 0.0)
+        encoded = (1.0 - abs(encoded.yx)) * sign_not_zero(encoded);
+    return encoded * 0.5 + 0.5;
+}
+
+vec3 decode_normal(vec2 encoded)
+{
+    encoded = encoded * 2.0 - 1.0;
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (normal.z < 0.0)
+        normal.xy = (1.0 - abs(normal.yx)) * sign_not_zero(normal.xy);
+    return normalize(normal);
+}
+
+// World-space position from the depth buffer, rather than storing it
+vec3 reconstruct_position(vec2 uv, float depth)
+{
+    vec4 world = inverse_view_projection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    return world.xyz / world.w;
+}
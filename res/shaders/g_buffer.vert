@@ -5,11 +5,11 @@ layout (location = 1) in vec2 texture_coord;
 layout (location = 2) in vec3 normal;
 layout (location = 3) in vec3 tangent;
 
-uniform mat4 model;
-uniform mat4 view_projection;
+#include "frame.glsl"
+
+layout (location = 4) in mat4 model; // per-instance
 uniform vec4 clip_plane;
 
-out vec4 out_position;
 out vec3 out_normal;
 out vec2 out_texture_coord;
 out mat3 out_tbn;
@@ -29,7 +29,6 @@ void main()
     T = normalize(T - dot(T, N) * N);
     vec3 B = cross(N, T);
 
-    out_position = world_space;
     out_normal = transpose(inverse(mat3(model))) * normal; // Apply model matrix to normal!
     out_texture_coord = texture_coord;
     out_tbn = mat3(T, B, N);
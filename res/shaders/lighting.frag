@@ -4,18 +4,18 @@ in vec2 out_texture_coord;
 
 uniform sampler2D g_albedo;
 uniform sampler2D g_normal;
-uniform sampler2D g_position;
+uniform sampler2D g_depth;
 uniform sampler2D occlusion;
-uniform sampler2D shadow_map;
-uniform sampler3D cloud_map;
+uniform sampler2DArray shadow_map;
+uniform sampler2DArrayShadow shadow_map_compare;
+uniform sampler2DArray shadow_moments;
+uniform sampler2D cloud_shadow_map;
 
-uniform vec3 ambient_light;
-uniform vec3 light_position;
-uniform vec3 light_colour;
-uniform mat4 lightspace;
+#include "frame.glsl"
+#include "g_buffer.glsl"
+#include "cloud_shadow.glsl"
 
-uniform float cloud_scale;
-uniform float cloud_offset;
+uniform vec3 ambient_light;
 
 layout (location = 0) out vec4 frag_colour;
 
@@ -87,29 +87,20 @@ const vec2 poisson_disk[64] = vec2[]
     vec2(-0.178564, -0.596057)
 );
 
-float get_shadow(vec4 lightspace_position)
+// Soft shadows with PCF + stratified Poisson sampling
+float get_poisson_shadow(vec3 proj_coords, int cascade)
 {
-    // Perspective divide
-    vec3 proj_coords = lightspace_position.xyz / lightspace_position.w;
-
-    // Transform to [0, 1] range
-    proj_coords = proj_coords * 0.5 + 0.5;
     float current_depth = proj_coords.z;
-
-    // If outside of shadow map, ditch
-    if(proj_coords.z > 1.0)
-        return 1;
-
-    // Soft shadows with PCF + stratified Poisson sampling
     const int samples = 64;
     float total_shadow = 0.0;
-    vec2 texel_size = 1.0 / textureSize(shadow_map, 0);
+    vec2 texel_size = 1.0 / textureSize(shadow_map, 0).xy;
     float spread = 2.5;
 
     for (int i = 0; i < samples; ++i)
     {
         const float bias = 0.0001;
-        float depth = texture(shadow_map, proj_coords.xy + poisson_disk[i] * texel_size * spread).r;
+        vec2 offset = poisson_disk[i] * texel_size * spread;
+        float depth = texture(shadow_map, vec3(proj_coords.xy + offset, cascade)).r;
         float shadow = step(current_depth - bias, depth);
         total_shadow += shadow;
     }
@@ -117,21 +108,98 @@ float get_shadow(vec4 lightspace_position)
     return total_shadow / samples;
 }
 
-float get_cloud_shadow(vec3 world_position)
+// 3x3 grid of hardware comparisons - each is itself bilinearly filtered, so
+// it's nearly as smooth as the Poisson disk for a fraction of the taps
+float get_pcf_shadow(vec3 proj_coords, int cascade)
 {
-    vec2 cloud_pos = (world_position.xz + cloud_offset) * 0.01 * cloud_scale;
-    float density = texture(cloud_map, vec3(cloud_pos, 0)).r;
-    density = pow(density, 4) * 2;
-    return max(1.0 - density, 0);
+    const float bias = 0.0001;
+    vec2 texel_size = 1.0 / textureSize(shadow_map_compare, 0).xy;
+    float total_shadow = 0.0;
+
+    for (int x = -1; x <= 1; ++x)
+    {
+        for (int y = -1; y <= 1; ++y)
+        {
+            vec2 offset = vec2(x, y) * texel_size * 1.5;
+            total_shadow += texture(shadow_map_compare, vec4(proj_coords.xy + offset, cascade, proj_coords.z - bias));
+        }
+    }
+
+    return total_shadow / 9.0;
+}
+
+// Must match evsm.frag
+const vec2 evsm_exponents = vec2(5.0, 5.0);
+
+float chebyshev_upper_bound(vec2 moments, float mean, float minimum_variance)
+{
+    if (mean <= moments.x)
+        return 1.0;
+
+    float variance = max(moments.y - moments.x * moments.x, minimum_variance);
+    float difference = mean - moments.x;
+    float p = variance / (variance + difference * difference);
+
+    // Cut off the tail of the bound to hide light bleeding
+    return clamp((p - 0.2) / 0.8, 0.0, 1.0);
+}
+
+// Single (prefiltered) tap of exponentially-warped moments
+float get_evsm_shadow(vec3 proj_coords, int cascade)
+{
+    vec4 moments = texture(shadow_moments, vec3(proj_coords.xy, cascade));
+
+    float depth = proj_coords.z * 2.0 - 1.0;
+    float positive = exp(evsm_exponents.x * depth);
+    float negative = -exp(-evsm_exponents.y * depth);
+
+    // Scale the minimum variance by each warp's derivative
+    const float minimum_variance = 0.0001;
+    vec2 depth_scale = minimum_variance * evsm_exponents * vec2(positive, -negative);
+    depth_scale *= depth_scale;
+
+    float positive_shadow = chebyshev_upper_bound(moments.xy, positive, depth_scale.x);
+    float negative_shadow = chebyshev_upper_bound(moments.zw, negative, depth_scale.y);
+    return min(positive_shadow, negative_shadow);
+}
+
+float get_shadow(vec3 world_position, float view_depth)
+{
+    // Pick the cascade whose slice of the view frustum we're in
+    int cascades = int(shadow_settings.x);
+    if (view_depth > cascade_splits[cascades - 1])
+        return 1.0;
+
+    int cascade = 0;
+    for (int i = 0; i < cascades - 1; ++i)
+        if (view_depth > cascade_splits[i])
+            cascade = i + 1;
+
+    vec4 lightspace_position = lightspace[cascade] * vec4(world_position, 1.0);
+
+    // Perspective divide
+    vec3 proj_coords = lightspace_position.xyz / lightspace_position.w;
+
+    // Transform to [0, 1] range
+    proj_coords = proj_coords * 0.5 + 0.5;
+
+    // If outside of shadow map, ditch
+    if(proj_coords.z > 1.0)
+        return 1.0;
+
+    int filter_mode = int(shadow_settings.y);
+    if (filter_mode == 1) return get_pcf_shadow(proj_coords, cascade);
+    if (filter_mode == 2) return get_evsm_shadow(proj_coords, cascade);
+    return get_poisson_shadow(proj_coords, cascade);
 }
 
 void main()
 {
     // Sample g-buffer
     vec3 albedo = texture(g_albedo, out_texture_coord).xyz;
-    vec3 normal = texture(g_normal, out_texture_coord).xyz;
-    vec3 position = texture(g_position, out_texture_coord).xyz;
-    vec4 lightspace_position = lightspace * vec4(position, 1.0);
+    vec3 normal = decode_normal(texture(g_normal, out_texture_coord).xy);
+    vec3 position = reconstruct_position(out_texture_coord, texture(g_depth, out_texture_coord).r);
+    float view_depth = -(view * vec4(position, 1.0)).z;
     float occlusion = texture(occlusion, out_texture_coord).r;
 
     // Ambient lighting
@@ -139,12 +207,12 @@ void main()
     vec3 ambience = ambient_light * occlusion;
 
     // Diffuse lighting - assume light to be a direction (e.g. the sun and i.e. not a point light)
-    vec3 light_direction = normalize(light_position);
-    vec3 diffuse = max(dot(normal, light_direction), 0.0) * light_colour;
+    vec3 light_direction = normalize(sun_position.xyz);
+    vec3 diffuse = max(dot(normal, light_direction), 0.0) * sun_colour.rgb;
     diffuse += ambience;
 
     // Shadows
-    float shadow = max(get_shadow(lightspace_position), 0.4 * occlusion);
-    float cloud_shadow = max(get_cloud_shadow(position.xyz), 0.3 * occlusion);
+    float shadow = max(get_shadow(position, view_depth), 0.4 * occlusion);
+    float cloud_shadow = max(get_cloud_shadow(cloud_shadow_map, position.xyz), 0.3 * occlusion);
     frag_colour = vec4(albedo, 1.0) * vec4(diffuse, 1.0) * shadow * cloud_shadow;
 }
@@ -1,10 +1,12 @@
 #version 330 core
 
 layout (location = 0) in vec3 pos;
-uniform mat4 mvp;
-out vec3 out_position;
+#include "frame.glsl"
+
+layout (location = 4) in mat4 model; // per-instance
+uniform int cascade;
 
 void main()
 {
-    gl_Position = mvp * vec4(pos, 1.0);
+    gl_Position = lightspace[cascade] * model * vec4(pos, 1.0);
 }
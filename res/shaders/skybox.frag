@@ -4,15 +4,16 @@ in vec3 tex_coords;
 
 uniform samplerCube skybox;
 uniform sampler2D depth;
-uniform vec2 screen_size;
 uniform vec3 tint;
 
+#include "frame.glsl"
+
 out vec4 frag_colour;
 
 void main()
 {
     // UVs for below
-    vec2 screen_space = gl_FragCoord.xy / screen_size;
+    vec2 screen_space = gl_FragCoord.xy / screen.xy;
 
     // Only render if not behind other objects
     // (done this way as we're a deferred renderer)
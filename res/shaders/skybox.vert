@@ -1,11 +1,13 @@
 #version 330 core
 
 layout (location = 0) in vec3 pos;
-uniform mat4 matrix;
 out vec3 tex_coords;
 
+#include "frame.glsl"
+
 void main()
 {
+    // Remove translation element from view matrix
     tex_coords = pos;
-    gl_Position = matrix * vec4(pos, 1.0);
+    gl_Position = projection * mat4(mat3(view)) * vec4(pos, 1.0);
 }
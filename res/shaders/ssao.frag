@@ -2,28 +2,33 @@
 
 in vec2 out_texture_coord;
 
-uniform sampler2D position;
 uniform sampler2D normal;
 uniform sampler2D depth;
 uniform sampler2D noise;
 uniform vec3 kernel[16];
 uniform vec2 noise_scale;
-uniform mat4 view;
-uniform mat4 projection;
 uniform float radius = 0.5;
 uniform float bias = 0.025;
 uniform float sharpness = 1.0;
 
+#include "frame.glsl"
+#include "g_buffer.glsl"
+
 layout (location = 0) out float frag_colour;
 
+vec3 get_position(vec2 uv)
+{
+    return reconstruct_position(uv, texture(depth, uv).r);
+}
+
 void main()
 {
     // Sample and convert to view-space
     // NOTE: the "0.0" in the vec4 of the normal makes the effect work better,
     //       and removes artifacts, but is technically incorrect. It just seems
     //       to work better that way...
-    vec3 pos = (view * vec4(texture(position, out_texture_coord).xyz, 1.0)).xyz;
-    vec3 normal = (view * vec4(texture(normal, out_texture_coord).xyz, 0.0)).xyz;
+    vec3 pos = (view * vec4(get_position(out_texture_coord), 1.0)).xyz;
+    vec3 normal = (view * vec4(decode_normal(texture(normal, out_texture_coord).xy), 0.0)).xyz;
     vec3 random = texture(noise, out_texture_coord * noise_scale).xyz;
 
     // Compose TBN matrix
@@ -44,7 +49,7 @@ void main()
         offset.xyz /= offset.w;
         offset.xyz = offset.xyz * 0.5 + 0.5;
 
-        float sample_depth = (view * vec4(texture(position, offset.xy).xyz, 1.0)).z;
+        float sample_depth = (view * vec4(get_position(offset.xy), 1.0)).z;
         float range_check = smoothstep(0.0, 1.0, radius / abs(pos.z - sample_depth));
         occlusion += (sample_depth >= sample_position.z + bias ? 1.0 : 0.0) * range_check;
     }
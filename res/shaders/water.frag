@@ -2,36 +2,155 @@
 
 in vec2 out_texture_coord;
 in vec4 out_clip_space;
+in vec3 out_world_position;
 in vec3 out_to_camera;
 in vec3 out_from_light;
 
-uniform sampler2D reflection_texture;
-uniform sampler2D refraction_texture;
+uniform sampler2D scene_colour;
 uniform sampler2D depth_map;
+uniform sampler2D depth_pyramid;
 uniform sampler2D distortion_map;
 uniform sampler2D normal_map;
+uniform samplerCube skybox;
+uniform sampler2D cloud_shadow_map;
 
-uniform vec3 light_direction;
-uniform vec3 light_colour;
+#include "frame.glsl"
+#include "cloud_shadow.glsl"
 
-uniform float z_near;
-uniform float z_far;
 uniform float time;
 
+// Reflections
+uniform bool reflections;
+uniform float max_distance;
+uniform float thickness;
+uniform int max_level;
+uniform bool has_skybox;
+uniform vec3 sky_tint;
+uniform vec3 sky_colour;
+
 layout (location = 0) out vec4 frag_colour;
 
 const float waviness = 0.002;
 const float loss = 0.8;
 const float fog = 0.2;
+const float ripple = 0.2;
 
 const float specular_damper = 20.0;
 const float specular_factor = 0.6;
 
+const int max_iterations = 64;
+
 float linearise_depth(float d)
 {
+    float z_near = screen.z;
+    float z_far = screen.w;
     return z_near * z_far / (z_far + d * (z_near - z_far));
 }
 
+// World space to texture coordinates (and depth)
+vec3 get_screen_position(vec4 clip_space)
+{
+    return (clip_space.xyz / clip_space.w) * 0.5 + 0.5;
+}
+
+// How far along the ray it leaves the given cell - nudged just past the edge
+// so the next lookup lands in the neighbouring one
+float get_cell_exit(vec3 origin, vec3 direction, vec2 cell, vec2 cell_count, vec2 cross_step, vec2 cross_offset)
+{
+    vec2 planes = (cell + cross_step) / cell_count + cross_offset;
+    vec2 solutions = (planes - origin.xy) / direction.xy;
+    return min(solutions.x, solutions.y);
+}
+
+// Hierarchical ray march through the depth pyramid (origin + direction * t for
+// t in [0, 1], in texture coordinates and depth). Empty space is skipped by
+// climbing to coarser levels, and hits are refined by dropping back down.
+bool trace(vec3 origin, vec3 direction, out vec2 hit, out float hit_distance)
+{
+    hit = vec2(0.0);
+    hit_distance = 1.0;
+
+    // Only rays heading away from the camera can be followed this way (the
+    // rest would mostly hit things behind it anyway)
+    if (direction.z <= 0.0)
+        return false;
+
+    direction.xy = mix(vec2(1e-6), direction.xy, greaterThan(abs(direction.xy), vec2(1e-6)));
+    vec2 cross_step = vec2(direction.x >= 0.0 ? 1.0 : -1.0, direction.y >= 0.0 ? 1.0 : -1.0);
+    vec2 cross_offset = cross_step / vec2(textureSize(depth_pyramid, 0)) / 128.0;
+    cross_step = clamp(cross_step, 0.0, 1.0);
+
+    // Step out of the first texel so the ray doesn't hit where it started
+    vec2 cell_count = vec2(textureSize(depth_pyramid, 0));
+    float t = get_cell_exit(origin, direction, floor(origin.xy * cell_count), cell_count, cross_step, cross_offset);
+
+    int level = 0;
+    for (int i = 0; i < max_iterations && level >= 0; ++i)
+    {
+        vec3 ray = origin + direction * t;
+        if (t > 1.0 || any(lessThan(ray.xy, vec2(0.0))) || any(greaterThan(ray.xy, vec2(1.0))))
+            return false;
+
+        cell_count = vec2(textureSize(depth_pyramid, level));
+        vec2 cell = floor(ray.xy * cell_count);
+        float nearest = texelFetch(depth_pyramid, ivec2(cell), level).r;
+
+        // In front of everything in this cell - skip ahead to its nearest
+        // depth, but if that'd leave the cell, stop at the edge and go coarser
+        float next_t = ray.z < nearest ? (nearest - origin.z) / direction.z : t;
+        if (floor((origin.xy + direction.xy * next_t) * cell_count) != cell)
+        {
+            next_t = get_cell_exit(origin, direction, cell, cell_count, cross_step, cross_offset);
+            level = min(level + 2, max_level + 1);
+        }
+        t = next_t;
+        --level;
+    }
+
+    // Ran out of iterations, or passed behind something rather than hitting it
+    vec3 ray = origin + direction * t;
+    float surface = texelFetch(depth_pyramid, ivec2(ray.xy * textureSize(depth_pyramid, 0)), 0).r;
+    if (level >= 0 || t > 1.0 || surface == 1.0 || linearise_depth(ray.z) - linearise_depth(surface) > thickness)
+        return false;
+
+    hit = ray.xy;
+    hit_distance = t;
+    return true;
+}
+
+vec3 get_sky(vec3 direction)
+{
+    return has_skybox ? texture(skybox, direction).rgb * sky_tint : sky_colour;
+}
+
+vec3 get_reflection(vec3 direction)
+{
+    vec3 sky = get_sky(direction);
+    if (!reflections)
+        return sky;
+
+    // Keep the ray's end in front of the near plane
+    vec3 view_position = (view * vec4(out_world_position, 1.0)).xyz;
+    vec3 view_direction = mat3(view) * direction;
+    float ray_length = max_distance;
+    if (view_direction.z > 0.0)
+        ray_length = min(ray_length, 0.99 * (-screen.z - view_position.z) / view_direction.z);
+
+    vec3 origin = get_screen_position(projection * vec4(view_position, 1.0));
+    vec3 end = get_screen_position(projection * vec4(view_position + view_direction * ray_length, 1.0));
+
+    vec2 hit;
+    float hit_distance;
+    if (!trace(origin, end - origin, hit, hit_distance))
+        return sky;
+
+    // Fade out towards the edges of the screen and the end of the ray, where
+    // the trace is about to lose what it's reflecting
+    vec2 edge = smoothstep(0.0, 0.1, hit) * (1.0 - smoothstep(0.9, 1.0, hit));
+    float confidence = edge.x * edge.y * (1.0 - smoothstep(0.8, 1.0, hit_distance));
+    return mix(sky, texture(scene_colour, hit).rgb, confidence);
+}
+
 void main()
 {
     // Apply du/dv (distortion) texture multiple times
@@ -42,28 +161,36 @@ void main()
     // Convert from clip space to "texture-coordinate space"
     vec2 ndc_space = (out_clip_space.xy / out_clip_space.w) / 2.0 + 0.5;
 
-    // Sample depth
+    // Sample depth (no depth testing here - anything in front hides us)
     float depth = texture(depth_map, ndc_space).r;
     float distance_to_floor = linearise_depth(depth);
     float distance_to_water = linearise_depth(gl_FragCoord.z);
     float water_depth = distance_to_floor - distance_to_water;
-
-    // Apply distortion for reflection and refraction
-    ndc_space += distortion;
-    vec4 reflection = texture(reflection_texture, vec2(ndc_space.x, 1 - ndc_space.y));
-    vec4 refraction = texture(refraction_texture, ndc_space);
+    if (water_depth <= 0.0)
+        discard;
 
     // Normal mapping
     vec4 normal_sample = texture(normal_map, distortion);
     vec3 normal = vec3(normal_sample.r * 2.0 - 1.0, normal_sample.b, normal_sample.g * 2.0 -  1.0);
     normal = normalize(normal);
 
+    // Refraction - whatever's already been lit beneath us, unless the
+    // distortion would pull in something above the water
+    vec2 refraction_uv = ndc_space + distortion;
+    if (linearise_depth(texture(depth_map, refraction_uv).r) < distance_to_water)
+        refraction_uv = ndc_space;
+    vec4 refraction = vec4(texture(scene_colour, refraction_uv).rgb, 1.0);
+
+    // Reflection (with the ripples toned down, so rays don't dive into the water)
+    vec3 view_vector = normalize(out_to_camera);
+    vec3 reflection_normal = normalize(mix(vec3(0.0, 1.0, 0.0), normal, ripple));
+    vec4 reflection = vec4(get_reflection(reflect(-view_vector, reflection_normal)), 1.0);
+
     // Water fog
     float fog = water_depth * fog;
     refraction = mix(refraction, vec4(0,0,0,0), clamp(fog, 0.0, 0.8));
 
     // Fresnel - bias towards refraction
-    vec3 view_vector = normalize(out_to_camera);
     float fresnel = dot(view_vector, normal) + 0.3;
     frag_colour = mix(reflection, refraction, clamp(fresnel, 0, 1));
     frag_colour *= loss;
@@ -72,7 +199,8 @@ void main()
     vec3 reflected_light = reflect(normalize(out_from_light), normal);
     float specular = max(dot(reflected_light, view_vector), 0.0);
     specular = pow(specular, specular_damper) * specular_factor;
-    frag_colour += vec4(specular * light_colour, 0);
+    specular *= get_cloud_shadow(cloud_shadow_map, out_world_position);
+    frag_colour += vec4(specular * sun_colour.rgb, 0);
 
     // Make water transparent near edges to mask ugly seam
     frag_colour.a = clamp(water_depth*10, 0, 1);
@@ -1,10 +1,11 @@
 #include "chunk.h"
+#include "cpu_profiler.h"
 #include "entity.h"
 #include "chunk_faces.h"
 #include <glm/gtc/noise.hpp>
 #include <stdexcept>
 
-Texture* Chunk::texture = nullptr;
+TextureRef Chunk::texture = {};
 const glm::vec2 texture_size = { 256.0f, 256.0f };
 const glm::vec2 subtexture_size = { 16.0f, 16.0f };
 
@@ -20,7 +21,7 @@ Chunk::Chunk(const glm::ivec3 position)
     generate_mesh();
 
     // Convert chunks-space position to world-space
-    transform.position = position * glm::ivec3 { size, size, size };
+    transform.set_position(position * glm::ivec3 { size, size, size });
 }
 
 void Chunk::rebuild_mesh()
@@ -30,6 +31,7 @@ void Chunk::rebuild_mesh()
 
 void Chunk::generate_blocks(const glm::ivec3 position)
 {
+    PROFILE_ZONE("Chunk::generate_blocks");
     const auto sample_noise = [](glm::vec2 pos, float scale)
     {
         const auto val = glm::simplex(pos * scale);
@@ -102,6 +104,7 @@ void Chunk::generate_blocks(const glm::ivec3 position)
 
 void Chunk::generate_mesh()
 {
+    PROFILE_ZONE("Chunk::generate_mesh");
     const auto is_solid_block = [&](int x, int y, int z)
     {
         // TODO: check against adjacent chunks
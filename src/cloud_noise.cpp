@@ -0,0 +1,353 @@
+#include "cloud_noise.h"
+#include "config.h"
+#include "cpu_profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CLOUD_NOISE_SSE
+#endif
+
+// Bump whenever the output changes, so old cache files are ignored
+constexpr unsigned int cache_version = 1;
+
+namespace
+{
+    // Everything below follows the original GLSL (heavily inspired by
+    // https://www.shadertoy.com/view/3dVXDc by "piyushslayer"), down to the
+    // order of operations, so it matches what the GPU used to produce
+    constexpr uint32_t UI0 = 1597334673u;
+    constexpr uint32_t UI1 = 3812015801u;
+    constexpr uint32_t UI2 = 2798796415u;
+    constexpr float UIF = 1.0f / 4294967296.0f; // float(0xffffffffU) rounds up to 2^32
+
+#ifdef CLOUD_NOISE_SSE
+    constexpr unsigned int lanes = 4;
+    struct Float { __m128 v; };
+    struct Uint { __m128i v; };
+
+    inline Float splat(const float f) { return { _mm_set1_ps(f) }; }
+    inline Float lane_offsets() { return { _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f) }; }
+    inline void store(float* out, const Float a) { _mm_storeu_ps(out, a.v); }
+
+    inline Float operator+(const Float a, const Float b) { return { _mm_add_ps(a.v, b.v) }; }
+    inline Float operator-(const Float a, const Float b) { return { _mm_sub_ps(a.v, b.v) }; }
+    inline Float operator*(const Float a, const Float b) { return { _mm_mul_ps(a.v, b.v) }; }
+    inline Float operator/(const Float a, const Float b) { return { _mm_div_ps(a.v, b.v) }; }
+    inline Float min(const Float a, const Float b) { return { _mm_min_ps(a.v, b.v) }; }
+    inline Float max(const Float a, const Float b) { return { _mm_max_ps(a.v, b.v) }; }
+    inline Float abs(const Float a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+
+    inline Float floor(const Float a)
+    {
+        // SSE2 has no floor - truncate, then fix up negative numbers
+        const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+        return { _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, a.v), _mm_set1_ps(1.0f))) };
+    }
+
+    inline Uint to_uint(const Float a) { return { _mm_cvttps_epi32(a.v) }; }
+
+    inline Float to_float(const Uint a)
+    {
+        // Nor an unsigned conversion, but 16-bit halves convert exactly, so only
+        // the final addition rounds (as a direct conversion would)
+        const __m128i high = _mm_srli_epi32(a.v, 16);
+        const __m128i low = _mm_and_si128(a.v, _mm_set1_epi32(0xffff));
+        return { _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(high), _mm_set1_ps(65536.0f)), _mm_cvtepi32_ps(low)) };
+    }
+
+    inline Uint operator^(const Uint a, const Uint b) { return { _mm_xor_si128(a.v, b.v) }; }
+
+    inline Uint operator*(const Uint a, const uint32_t b)
+    {
+        // Nor a 32-bit multiply (that's SSE4.1), so do even and odd lanes apart
+        const __m128i multiplier = _mm_set1_epi32((int)b);
+        const __m128i even = _mm_mul_epu32(a.v, multiplier);
+        const __m128i odd = _mm_mul_epu32(_mm_srli_si128(a.v, 4), multiplier);
+        return { _mm_unpacklo_epi32(
+            _mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0))
+        ) };
+    }
+#else
+    constexpr unsigned int lanes = 1;
+    struct Float { float v; };
+    struct Uint { uint32_t v; };
+
+    inline Float splat(const float f) { return { f }; }
+    inline Float lane_offsets() { return { 0.0f }; }
+    inline void store(float* out, const Float a) { *out = a.v; }
+
+    inline Float operator+(const Float a, const Float b) { return { a.v + b.v }; }
+    inline Float operator-(const Float a, const Float b) { return { a.v - b.v }; }
+    inline Float operator*(const Float a, const Float b) { return { a.v * b.v }; }
+    inline Float operator/(const Float a, const Float b) { return { a.v / b.v }; }
+    inline Float min(const Float a, const Float b) { return { std::min(a.v, b.v) }; }
+    inline Float max(const Float a, const Float b) { return { std::max(a.v, b.v) }; }
+    inline Float abs(const Float a) { return { std::abs(a.v) }; }
+    inline Float floor(const Float a) { return { std::floor(a.v) }; }
+
+    inline Uint to_uint(const Float a) { return { (uint32_t)(int32_t)a.v }; }
+    inline Float to_float(const Uint a) { return { (float)a.v }; }
+    inline Uint operator^(const Uint a, const Uint b) { return { a.v ^ b.v }; }
+    inline Uint operator*(const Uint a, const uint32_t b) { return { a.v * b }; }
+#endif
+
+    inline Float operator+(const Float a, const float b) { return a + splat(b); }
+    inline Float operator-(const Float a, const float b) { return a - splat(b); }
+    inline Float operator*(const Float a, const float b) { return a * splat(b); }
+    inline Float operator+(const float a, const Float b) { return splat(a) + b; }
+    inline Float operator-(const float a, const Float b) { return splat(a) - b; }
+    inline Float operator*(const float a, const Float b) { return splat(a) * b; }
+    inline Float fract(const Float a) { return a - floor(a); }
+
+    // GLSL's definition
+    inline Float mod(const Float x, const float y) { return x - splat(y) * floor(x / splat(y)); }
+
+    inline Float remap(const Float x, const Float a, const Float b, const Float c, const Float d)
+    {
+        return (((x - a) / (b - a)) * (d - c)) + c;
+    }
+
+    struct Vec3
+    {
+        Float x, y, z;
+
+        Vec3 operator+(const Vec3& o) const { return { x + o.x, y + o.y, z + o.z }; }
+        Vec3 operator-(const Vec3& o) const { return { x - o.x, y - o.y, z - o.z }; }
+        Vec3 operator*(const Float f) const { return { x * f, y * f, z * f }; }
+        Vec3 operator*(const float f) const { return { x * f, y * f, z * f }; }
+        Vec3 operator+(const float f) const { return { x + f, y + f, z + f }; }
+    };
+
+    inline Vec3 splat(const float x, const float y, const float z) { return { splat(x), splat(y), splat(z) }; }
+    inline Vec3 floor(const Vec3& v) { return { floor(v.x), floor(v.y), floor(v.z) }; }
+    inline Vec3 fract(const Vec3& v) { return { fract(v.x), fract(v.y), fract(v.z) }; }
+    inline Vec3 mod(const Vec3& v, const float y) { return { mod(v.x, y), mod(v.y, y), mod(v.z, y) }; }
+    inline Float dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+    Vec3 hash33(const Vec3& p)
+    {
+        const Uint qx = to_uint(p.x) * UI0;
+        const Uint qy = to_uint(p.y) * UI1;
+        const Uint qz = to_uint(p.z) * UI2;
+        const Uint q = qx ^ qy ^ qz;
+        return {
+            -1.0f + 2.0f * to_float(q * UI0) * UIF,
+            -1.0f + 2.0f * to_float(q * UI1) * UIF,
+            -1.0f + 2.0f * to_float(q * UI2) * UIF
+        };
+    }
+
+    // Gradient noise by iq (modified to be tileable)
+    Float gradient_noise(const Vec3& x, const float freq)
+    {
+        // Grid
+        const Vec3 p = floor(x);
+        const Vec3 w = fract(x);
+
+        // Quintic interpolant
+        const Vec3 u = {
+            w.x * w.x * w.x * (w.x * (w.x * 6.0f - 15.0f) + 10.0f),
+            w.y * w.y * w.y * (w.y * (w.y * 6.0f - 15.0f) + 10.0f),
+            w.z * w.z * w.z * (w.z * (w.z * 6.0f - 15.0f) + 10.0f)
+        };
+
+        // Gradients and their projections
+        const auto corner = [&](const float cx, const float cy, const float cz)
+        {
+            const Vec3 offset = splat(cx, cy, cz);
+            return dot(hash33(mod(p + offset, freq)), w - offset);
+        };
+        const Float va = corner(0.0f, 0.0f, 0.0f);
+        const Float vb = corner(1.0f, 0.0f, 0.0f);
+        const Float vc = corner(0.0f, 1.0f, 0.0f);
+        const Float vd = corner(1.0f, 1.0f, 0.0f);
+        const Float ve = corner(0.0f, 0.0f, 1.0f);
+        const Float vf = corner(1.0f, 0.0f, 1.0f);
+        const Float vg = corner(0.0f, 1.0f, 1.0f);
+        const Float vh = corner(1.0f, 1.0f, 1.0f);
+
+        // Interpolation
+        return va +
+            u.x * (vb - va) +
+            u.y * (vc - va) +
+            u.z * (ve - va) +
+            u.x * u.y * (va - vb - vc + vd) +
+            u.y * u.z * (va - vc - ve + vg) +
+            u.z * u.x * (va - vb - ve + vf) +
+            u.x * u.y * u.z * (splat(0.0f) - va + vb + vc - vd + ve - vf - vg + vh);
+    }
+
+    // Tileable 3D Worley noise (inverted)
+    Float worley_noise(const Vec3& uv, const float freq)
+    {
+        const Vec3 id = floor(uv);
+        const Vec3 p = fract(uv);
+
+        Float min_distance = splat(10000.0f);
+        for (float x = -1.0f; x <= 1.0f; ++x)
+        {
+            for (float y = -1.0f; y <= 1.0f; ++y)
+            {
+                for (float z = -1.0f; z <= 1.0f; ++z)
+                {
+                    const Vec3 offset = splat(x, y, z);
+                    const Vec3 h = hash33(mod(id + offset, freq)) * 0.5f + 0.5f + offset;
+                    const Vec3 d = p - h;
+                    min_distance = min(min_distance, dot(d, d));
+                }
+            }
+        }
+
+        return 1.0f - min_distance;
+    }
+
+    // Fbm for Perlin noise based on iq's blog
+    Float perlin_fbm(const Vec3& p, float freq, const int octaves)
+    {
+        const float G = std::exp2(-0.85f);
+        float amplitude = 1.0f;
+        Float noise = splat(0.0f);
+        for (int i = 0; i < octaves; ++i)
+        {
+            noise = noise + amplitude * gradient_noise(p * freq, freq);
+            freq *= 2.0f;
+            amplitude *= G;
+        }
+        return noise;
+    }
+
+    // Tileable Worley fbm inspired by Andrew Schneider's Real-Time Volumetric
+    // Cloudscapes chapter in GPU Pro 7
+    Float worley_fbm(const Vec3& p, const float freq)
+    {
+        return worley_noise(p * freq, freq) * 0.625f +
+            worley_noise(p * freq * 2.0f, freq * 2.0f) * 0.25f +
+            worley_noise(p * freq * 4.0f, freq * 4.0f) * 0.125f;
+    }
+
+    Float texel(const Vec3& sample_coord, const float scale, const bool just_perlin)
+    {
+        const Float zero = splat(0.0f);
+        const Float one = splat(1.0f);
+        Float value;
+
+        if (!just_perlin)
+        {
+            Float pfbm = one * (1.0f - 0.5f) + perlin_fbm(sample_coord, 4.0f, 7) * 0.5f;
+            pfbm = abs(pfbm * 2.0f - 1.0f); // billowy perlin noise
+
+            const Float g = worley_fbm(sample_coord, scale);
+            const Float b = worley_fbm(sample_coord, scale * 2.0f);
+            const Float a = worley_fbm(sample_coord, scale * 4.0f);
+            const Float r = remap(pfbm, zero, one, g, one); // perlin-worley
+
+            value = (g + b + a + r) / splat(4.0f);
+        }
+        else
+        {
+            Float pfbm = one * (1.0f - 0.5f) + perlin_fbm(sample_coord * scale, 4.0f, 7) * 0.5f;
+            pfbm = abs(pfbm * 2.0f - 1.0f);
+            value = remap(pfbm, zero, one, zero, one);
+        }
+
+        return min(max(value, zero), one);
+    }
+
+    void generate_slice(float* out, const unsigned int z, const unsigned int size, const float scale, const bool just_perlin)
+    {
+        PROFILE_ZONE("cloud_noise::generate_slice");
+        const Float size_float = splat((float)size);
+        const Float sample_z = splat((float)z) / size_float;
+        float results[lanes];
+
+        for (unsigned int y = 0; y < size; ++y)
+        {
+            const Float sample_y = splat((float)y) / size_float;
+            for (unsigned int x = 0; x < size; x += lanes)
+            {
+                const Float sample_x = (splat((float)x) + lane_offsets()) / size_float;
+                store(results, texel({ sample_x, sample_y, sample_z }, scale, just_perlin));
+
+                const unsigned int count = std::min(lanes, size - x);
+                std::copy(results, results + count, out + (size_t)y * size + x);
+            }
+        }
+    }
+
+    std::string get_cache_path(const unsigned int size, const float scale, const bool just_perlin)
+    {
+        // Exact bits of the scale, so no two scales share a file
+        uint32_t scale_bits;
+        std::memcpy(&scale_bits, &scale, sizeof(scale_bits));
+
+        std::stringstream path;
+        path << CLOUD_NOISE_CACHE_DIRECTORY << (just_perlin ? "perlin" : "worley") << "-v" << cache_version
+             << "-" << size << "-" << std::hex << scale_bits << ".bin";
+        return path.str();
+    }
+}
+
+std::vector<float> cloud_noise::generate(const unsigned int size, const float scale, const bool just_perlin)
+{
+    PROFILE_ZONE("cloud_noise::generate");
+    std::vector<float> texels((size_t)size * size * size);
+
+    // Threads take slices as they finish their last one
+    std::atomic<unsigned int> next_slice = 0;
+    const auto worker = [&]()
+    {
+        for (unsigned int z = next_slice++; z < size; z = next_slice++)
+            generate_slice(texels.data() + (size_t)z * size * size, z, size, scale, just_perlin);
+    };
+
+    const unsigned int thread_count = std::clamp(std::thread::hardware_concurrency(), 1u, std::max(size, 1u));
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < thread_count; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+        thread.join();
+
+    return texels;
+}
+
+std::vector<float> cloud_noise::load_or_generate(const unsigned int size, const float scale, const bool just_perlin)
+{
+    if (!CLOUD_NOISE_CACHE) return generate(size, scale, just_perlin);
+
+    const std::string path = get_cache_path(size, scale, just_perlin);
+    const size_t bytes = (size_t)size * size * size * sizeof(float);
+
+    std::ifstream in(path, std::ios::binary);
+    if (in)
+    {
+        std::vector<float> texels((size_t)size * size * size);
+        if (in.read((char*)texels.data(), bytes) && in.peek() == std::ifstream::traits_type::eof())
+            return texels;
+    }
+
+    std::vector<float> texels = generate(size, scale, just_perlin);
+
+    std::error_code error;
+    std::filesystem::create_directories(CLOUD_NOISE_CACHE_DIRECTORY, error);
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+    {
+        std::cerr << "unable to write cloud noise cache " << path << std::endl;
+        return texels;
+    }
+    out.write((const char*)texels.data(), bytes);
+
+    return texels;
+}
@@ -0,0 +1,263 @@
+#include "cpu_profiler.h"
+
+#if CPU_PROFILER
+#include "imgui.h"
+#include <atomic>
+#include <chrono>
+#include <array>
+#include <vector>
+#include <deque>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+
+namespace cpu_profiler
+{
+    namespace
+    {
+        struct Event
+        {
+            const char* name;
+            uint64_t begin;
+            uint64_t end;
+            uint32_t depth;
+        };
+
+        constexpr uint64_t buffer_size = CPU_PROFILER_BUFFER_SIZE;
+        static_assert((buffer_size & (buffer_size - 1)) == 0, "profiler buffer size must be a power of two");
+
+        // Only its thread writes events (then publishes them by bumping head),
+        // and only the main thread reads them back (up to head). Threads give
+        // their buffer up when they exit, for the next new thread to take over.
+        struct ThreadBuffer
+        {
+            std::array<Event, buffer_size> events;
+            std::atomic<uint64_t> head = 0;
+            uint64_t tail = 0;
+            std::atomic<bool> in_use = false;
+            unsigned int id = 0;
+            ThreadBuffer* next = nullptr;
+        };
+
+        std::atomic<ThreadBuffer*> buffers = nullptr;
+        std::atomic<unsigned int> buffer_count = 0;
+        const auto epoch = std::chrono::steady_clock::now();
+
+        ThreadBuffer* acquire_buffer()
+        {
+            for (ThreadBuffer* buffer = buffers.load(std::memory_order_acquire); buffer; buffer = buffer->next)
+            {
+                bool expected = false;
+                if (buffer->in_use.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+                    return buffer;
+            }
+
+            ThreadBuffer* buffer = new ThreadBuffer();
+            buffer->in_use = true;
+            buffer->id = buffer_count++;
+            buffer->next = buffers.load(std::memory_order_relaxed);
+            while (!buffers.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed));
+            return buffer;
+        }
+
+        struct ThreadState
+        {
+            ThreadBuffer* buffer = acquire_buffer();
+            uint32_t depth = 0;
+
+            ~ThreadState()
+            {
+                buffer->in_use.store(false, std::memory_order_release);
+            }
+        };
+
+        thread_local ThreadState thread_state;
+
+        struct Spike
+        {
+            uint64_t frame;
+            float ms;
+            float average_ms;
+            std::string zones;
+        };
+
+        // Main thread only from here on
+        uint64_t frame = 0;
+        uint64_t last_frame_end = 0;
+        float frame_ms = 0.0f;
+        float average_frame_ms = 0.0f;
+        uint64_t dropped_events = 0;
+        std::deque<Spike> spikes;
+
+        unsigned int capture_frames_left = 0;
+        std::string capture_filename;
+        std::vector<std::pair<Event, unsigned int>> captured;
+
+        std::string escape(const char* name)
+        {
+            std::string escaped;
+            for (const char* c = name; *c; ++c)
+            {
+                if (*c == '"' || *c == '\\') escaped += '\\';
+                escaped += *c;
+            }
+            return escaped;
+        }
+
+        void write_trace(const std::string& filename, const unsigned int main_thread)
+        {
+            std::ofstream out(filename);
+            if (!out)
+            {
+                std::cerr << "unable to write CPU trace " << filename << std::endl;
+                return;
+            }
+
+            // Complete ("X") events, in microseconds
+            out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+            for (unsigned int i = 0; i < buffer_count; ++i)
+            {
+                out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i
+                    << ",\"args\":{\"name\":\"" << (i == main_thread ? std::string("Main thread") : "Thread " + std::to_string(i)) << "\"}},\n";
+            }
+
+            out.precision(3);
+            out << std::fixed;
+            for (size_t i = 0; i < captured.size(); ++i)
+            {
+                const auto& [event, thread] = captured[i];
+                out << "{\"name\":\"" << escape(event.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread
+                    << ",\"ts\":" << event.begin / 1000.0 << ",\"dur\":" << (event.end - event.begin) / 1000.0 << "}"
+                    << (i + 1 < captured.size() ? ",\n" : "\n");
+            }
+            out << "]}\n";
+
+            std::cout << "wrote " << captured.size() << " CPU zones to " << filename << std::endl;
+        }
+    }
+
+    uint64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    Zone::Zone(const char* name) : name(name), begin(now())
+    {
+        thread_state.depth++;
+    }
+
+    Zone::~Zone()
+    {
+        const uint64_t end = now();
+        ThreadState& state = thread_state;
+        state.depth--;
+
+        ThreadBuffer& buffer = *state.buffer;
+        const uint64_t head = buffer.head.load(std::memory_order_relaxed);
+        buffer.events[head & (buffer_size - 1)] = { name, begin, end, state.depth };
+        buffer.head.store(head + 1, std::memory_order_release);
+    }
+
+    void end_frame()
+    {
+        const uint64_t frame_end = now();
+        const unsigned int main_thread = thread_state.buffer->id;
+        const bool capturing = capture_frames_left > 0;
+
+        // Drain every thread's zones - anything a thread overwrote before we got
+        // to it (or while we were copying it) is lost
+        std::vector<Event> events;
+        std::vector<Event> main_zones;
+        for (ThreadBuffer* buffer = buffers.load(std::memory_order_acquire); buffer; buffer = buffer->next)
+        {
+            const uint64_t head = buffer->head.load(std::memory_order_acquire);
+            if (head - buffer->tail > buffer_size)
+            {
+                dropped_events += head - buffer_size - buffer->tail;
+                buffer->tail = head - buffer_size;
+            }
+
+            events.clear();
+            for (uint64_t i = buffer->tail; i < head; ++i)
+                events.push_back(buffer->events[i & (buffer_size - 1)]);
+
+            // (the slot the next event's going into may be half written, too)
+            const uint64_t latest_head = buffer->head.load(std::memory_order_acquire);
+            for (uint64_t i = buffer->tail; i < head; ++i)
+            {
+                if (i + buffer_size <= latest_head)
+                {
+                    dropped_events++;
+                    continue;
+                }
+
+                const Event& event = events[i - buffer->tail];
+                if (capturing) captured.push_back({ event, buffer->id });
+                if (buffer->id == main_thread && event.depth <= 1 && event.end > last_frame_end)
+                    main_zones.push_back(event);
+            }
+            buffer->tail = head;
+        }
+
+        // Frame time spikes, along with the slowest zones behind them
+        frame_ms = (frame_end - last_frame_end) / 1e6f;
+        if (frame > 30 && frame_ms > average_frame_ms * CPU_PROFILER_SPIKE_FACTOR)
+        {
+            std::sort(main_zones.begin(), main_zones.end(), [](const Event& a, const Event& b)
+            {
+                return a.end - a.begin > b.end - b.begin;
+            });
+
+            std::ostringstream zones;
+            zones.precision(2);
+            zones << std::fixed;
+            for (size_t i = 0; i < std::min<size_t>(main_zones.size(), 5); ++i)
+                zones << (i ? ", " : "") << main_zones[i].name << " " << (main_zones[i].end - main_zones[i].begin) / 1e6f << " ms";
+
+            spikes.push_front({ frame, frame_ms, average_frame_ms, zones.str() });
+            if (spikes.size() > 8) spikes.pop_back();
+            std::cout << "frame " << frame << " took " << frame_ms << " ms (average " << average_frame_ms
+                      << " ms) - " << spikes.front().zones << std::endl;
+        }
+        average_frame_ms = frame <= 1 ? frame_ms : average_frame_ms + (frame_ms - average_frame_ms) * 0.05f;
+        last_frame_end = frame_end;
+        frame++;
+
+        if (capturing && --capture_frames_left == 0)
+        {
+            write_trace(capture_filename, main_thread);
+            captured.clear();
+
+            // Don't count writing it out against the next frame
+            last_frame_end = now();
+        }
+    }
+
+    void draw_gui()
+    {
+        ImGui::Begin("CPU profiler");
+        ImGui::Text("Frame: %.2f ms (average %.2f ms)", frame_ms, average_frame_ms);
+        ImGui::Text("Threads: %u", buffer_count.load());
+        ImGui::Text("Dropped zones: %llu", (unsigned long long)dropped_events);
+
+        if (capture_frames_left > 0) ImGui::Text("Capturing... %u frames left", capture_frames_left);
+        else if (ImGui::Button("Capture trace")) start_capture(CPU_PROFILER_CAPTURE_FRAMES);
+
+        ImGui::Text("Spikes (over %.1fx average):", CPU_PROFILER_SPIKE_FACTOR);
+        for (const auto& spike : spikes)
+            ImGui::TextWrapped("#%llu: %.2f ms (average %.2f) - %s",
+                (unsigned long long)spike.frame, spike.ms, spike.average_ms, spike.zones.c_str());
+        ImGui::End();
+    }
+
+    void start_capture(const unsigned int frames, const char* filename)
+    {
+        capture_frames_left = frames;
+        capture_filename = filename;
+        captured.clear();
+    }
+}
+
+#endif
@@ -1,6 +1,7 @@
 #include <glad/glad.h>
 #include <stdexcept>
 #include "framebuffer.h"
+#include "gl_state.h"
 
 Framebuffer::Framebuffer(
     const unsigned int width,
@@ -11,12 +12,23 @@ Framebuffer::Framebuffer(
 )
 {
     glGenFramebuffers(1, &fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    gl_state::bind_framebuffer(fbo);
 
     // Add colour attachment (if need be)
     if (depth_settings != DepthSettings::ONLY_DEPTH)
     {
-        if (!is_single_channel)
+        if (is_g_buffer)
+        {
+            // Albedo's only ever LDR
+            colour_texture.emplace(
+                width,
+                height,
+                GL_RGBA8,
+                GL_RGBA,
+                GL_UNSIGNED_BYTE
+            );
+        }
+        else if (!is_single_channel)
         {
             colour_texture.emplace(
                 width,
@@ -50,17 +62,15 @@ Framebuffer::Framebuffer(
         glReadBuffer(GL_NONE);
     }
 
-    // If G-buffer, add normal and position textures
+    // If G-buffer, add an (octahedral-encoded) normal texture - positions come
+    // from the depth buffer. Nearest filtering, as encoded normals don't blend.
     if (is_g_buffer)
     {
-        normal_texture.emplace(width, height, GL_RGB32F, GL_RGB, GL_FLOAT);
-        position_texture.emplace(width, height, GL_RGB32F, GL_RGB, GL_FLOAT);
+        normal_texture.emplace(width, height, GL_RG16, GL_RG, GL_UNSIGNED_SHORT, true);
         normal_texture->clamp(glm::vec4(0.0f), false);
-        position_texture->clamp(glm::vec4(0.0f), false);
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal_texture->texture_id, 0);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, position_texture->texture_id, 0);
-        unsigned int attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
-        glDrawBuffers(3, attachments);
+        unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, attachments);
     }
 
     if (depth_settings != DepthSettings::NO_DEPTH)
@@ -105,21 +115,30 @@ Framebuffer::Framebuffer(
         throw std::runtime_error("incomplete framebuffer - " +
             std::to_string(glCheckFramebufferStatus(GL_FRAMEBUFFER)));
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gl_state::bind_framebuffer(0);
     this->width = width;
     this->height = height;
 }
 
 void Framebuffer::bind() const
 {
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-    glViewport(0,0, width, height);
+    gl_state::bind_framebuffer(fbo);
+    gl_state::viewport(0, 0, width, height);
 }
 
 void Framebuffer::unbind(unsigned int previous_width, unsigned int previous_height) const
 {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(0,0, previous_width, previous_height);
+    gl_state::bind_framebuffer(0);
+    gl_state::viewport(0, 0, previous_width, previous_height);
+}
+
+void Framebuffer::blit_colour(const Framebuffer& target) const
+{
+    // Leaves the target bound for both, as far as the state cache knows
+    target.bind();
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, target.width, target.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target.fbo);
 }
 
 Framebuffer::~Framebuffer()
@@ -127,5 +146,6 @@ Framebuffer::~Framebuffer()
     if (rbo.has_value())
         glDeleteRenderbuffers(1, &rbo.value());
 
+    gl_state::forget_framebuffer(fbo);
     glDeleteFramebuffers(1, &fbo);
 }
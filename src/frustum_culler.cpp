@@ -0,0 +1,128 @@
+#include "frustum_culler.h"
+#include "cpu_profiler.h"
+#include <array>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define FRUSTUM_CULLER_SSE
+#endif
+
+void FrustumCuller::clear()
+{
+    centre_x.clear();
+    centre_y.clear();
+    centre_z.clear();
+    extent_x.clear();
+    extent_y.clear();
+    extent_z.clear();
+    count = 0;
+}
+
+uint32_t FrustumCuller::add(const AABB& bounds)
+{
+    const glm::vec3 centre = bounds.centre();
+    const glm::vec3 extents = bounds.extents();
+    centre_x.push_back(centre.x);
+    centre_y.push_back(centre.y);
+    centre_z.push_back(centre.z);
+    extent_x.push_back(extents.x);
+    extent_y.push_back(extents.y);
+    extent_z.push_back(extents.z);
+    return count++;
+}
+
+// Gribb-Hartmann - rows of the matrix combine into the six planes (normalised
+// so that distances are comparable with extents). A plane that can't reject
+// anything stands in for the near plane when it's not wanted.
+static std::array<glm::vec4, 6> extract_planes(const glm::mat4& matrix, const bool test_near_plane)
+{
+    const glm::mat4 m = glm::transpose(matrix);
+    std::array<glm::vec4, 6> planes =
+    {
+        m[3] + m[0], m[3] - m[0],
+        m[3] + m[1], m[3] - m[1],
+        m[3] - m[2], m[3] + m[2]
+    };
+
+    for (auto& plane : planes)
+        plane /= glm::length(glm::vec3(plane));
+
+    if (!test_near_plane)
+        planes[5] = { 0.0f, 0.0f, 1.0f, std::numeric_limits<float>::max() };
+    return planes;
+}
+
+void FrustumCuller::cull(
+    const glm::mat4& view_projection,
+    std::vector<uint8_t>& visible,
+    const bool test_near_plane
+) const
+{
+    PROFILE_ZONE("FrustumCuller::cull");
+    const auto planes = extract_planes(view_projection, test_near_plane);
+    visible.assign(count, 1);
+    size_t i = 0;
+
+#ifdef FRUSTUM_CULLER_SSE
+    // A box is outside if, for any plane, even its most positive corner is behind
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128 cx = _mm_loadu_ps(&centre_x[i]);
+        const __m128 cy = _mm_loadu_ps(&centre_y[i]);
+        const __m128 cz = _mm_loadu_ps(&centre_z[i]);
+        const __m128 ex = _mm_loadu_ps(&extent_x[i]);
+        const __m128 ey = _mm_loadu_ps(&extent_y[i]);
+        const __m128 ez = _mm_loadu_ps(&extent_z[i]);
+
+        __m128 outside = _mm_setzero_ps();
+        for (const auto& plane : planes)
+        {
+            const __m128 nx = _mm_set1_ps(plane.x);
+            const __m128 ny = _mm_set1_ps(plane.y);
+            const __m128 nz = _mm_set1_ps(plane.z);
+
+            // Signed distance of centre, plus projected radius of the box
+            __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(plane.w))
+            );
+            const __m128 radius = _mm_add_ps(
+                _mm_add_ps(
+                    _mm_mul_ps(_mm_andnot_ps(sign_mask, nx), ex),
+                    _mm_mul_ps(_mm_andnot_ps(sign_mask, ny), ey)
+                ),
+                _mm_mul_ps(_mm_andnot_ps(sign_mask, nz), ez)
+            );
+            distance = _mm_add_ps(distance, radius);
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, zero));
+        }
+
+        const int mask = _mm_movemask_ps(outside);
+        for (size_t lane = 0; lane < 4; ++lane)
+            visible[i + lane] = !(mask & (1 << lane));
+    }
+#endif
+
+    // Whatever's left over
+    for (; i < count; ++i)
+    {
+        for (const auto& plane : planes)
+        {
+            const float distance = plane.x * centre_x[i] + plane.y * centre_y[i] + plane.z * centre_z[i] + plane.w;
+            const float radius =
+                std::abs(plane.x) * extent_x[i] +
+                std::abs(plane.y) * extent_y[i] +
+                std::abs(plane.z) * extent_z[i];
+
+            if (distance + radius < 0.0f)
+            {
+                visible[i] = 0;
+                break;
+            }
+        }
+    }
+}
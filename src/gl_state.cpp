@@ -0,0 +1,152 @@
+#include "gl_state.h"
+#include "config.h"
+#include <glad/glad.h>
+#include <unordered_map>
+#include <array>
+
+namespace
+{
+    constexpr unsigned int unknown = ~0u;
+    constexpr unsigned int max_texture_units = 32;
+
+    struct TextureBinding
+    {
+        unsigned int target = unknown;
+        unsigned int texture = unknown;
+    };
+
+    struct State
+    {
+        unsigned int program = unknown;
+        unsigned int vao = unknown;
+        unsigned int fbo = unknown;
+        int viewport[4] = { -1, -1, -1, -1 };
+        unsigned int active_texture_unit = unknown;
+        std::array<TextureBinding, max_texture_units> textures = {};
+        std::unordered_map<unsigned int, bool> capabilities;
+        unsigned int cull_face = unknown;
+    };
+
+    State state;
+    gl_state::Stats stats;
+
+    // Returns whether the call needs making
+    bool count(const bool changed)
+    {
+#if DEBUG
+        if (changed) stats.issued++;
+        else stats.skipped++;
+#endif
+        return changed;
+    }
+
+    bool update(unsigned int& cached, const unsigned int value)
+    {
+        const bool changed = cached != value;
+        cached = value;
+        return count(changed);
+    }
+}
+
+namespace gl_state
+{
+    void use_program(const unsigned int program)
+    {
+        if (update(state.program, program)) glUseProgram(program);
+    }
+
+    void bind_vertex_array(const unsigned int vao)
+    {
+        if (update(state.vao, vao)) glBindVertexArray(vao);
+    }
+
+    void bind_framebuffer(const unsigned int fbo)
+    {
+        if (update(state.fbo, fbo)) glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    }
+
+    void viewport(const int x, const int y, const int width, const int height)
+    {
+        const bool changed = state.viewport[0] != x || state.viewport[1] != y ||
+            state.viewport[2] != width || state.viewport[3] != height;
+        if (!count(changed)) return;
+
+        state.viewport[0] = x;
+        state.viewport[1] = y;
+        state.viewport[2] = width;
+        state.viewport[3] = height;
+        glViewport(x, y, width, height);
+    }
+
+    void bind_texture(const unsigned int unit, const unsigned int target, const unsigned int texture)
+    {
+        // Units past what we track always go straight through
+        if (unit >= max_texture_units)
+        {
+            state.active_texture_unit = unit;
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(target, texture);
+            return;
+        }
+
+        TextureBinding& binding = state.textures[unit];
+        if (!count(binding.target != target || binding.texture != texture)) return;
+
+        if (update(state.active_texture_unit, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+        binding = { target, texture };
+        glBindTexture(target, texture);
+    }
+
+    void set_enabled(const unsigned int capability, const bool enabled)
+    {
+        const auto it = state.capabilities.find(capability);
+        unsigned int cached = it == state.capabilities.end() ? unknown : it->second;
+        if (!update(cached, enabled)) return;
+
+        state.capabilities[capability] = enabled;
+        if (enabled) glEnable(capability);
+        else glDisable(capability);
+    }
+
+    void cull_face(const unsigned int mode)
+    {
+        if (update(state.cull_face, mode)) glCullFace(mode);
+    }
+
+    void forget_program(const unsigned int program)
+    {
+        if (state.program == program) state.program = unknown;
+    }
+
+    void forget_vertex_array(const unsigned int vao)
+    {
+        if (state.vao == vao) state.vao = unknown;
+    }
+
+    void forget_framebuffer(const unsigned int fbo)
+    {
+        if (state.fbo == fbo) state.fbo = unknown;
+    }
+
+    void forget_texture(const unsigned int texture)
+    {
+        for (auto& binding : state.textures)
+            if (binding.texture == texture)
+                binding = {};
+    }
+
+    void invalidate()
+    {
+        state = {};
+    }
+
+    Stats get_stats()
+    {
+        return stats;
+    }
+
+    void reset_stats()
+    {
+        stats = {};
+    }
+}
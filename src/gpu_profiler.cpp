@@ -0,0 +1,190 @@
+#include "gpu_profiler.h"
+#include "imgui.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+GPUProfiler::~GPUProfiler()
+{
+    if (recording) write_csv(GPU_PROFILER_CSV);
+
+    for (auto& frame : frames)
+        if (!frame.queries.empty())
+            glDeleteQueries(frame.queries.size(), frame.queries.data());
+}
+
+void GPUProfiler::begin_frame()
+{
+    // This slot was last used GPU_PROFILER_LATENCY frames ago, so should be done
+    Frame& frame = frames[frame_number % frames.size()];
+    collect(frame);
+    frame.number = frame_number;
+    frame.queries_used = 0;
+    frame.timings.clear();
+    open_timings.clear();
+
+    begin("Frame");
+}
+
+void GPUProfiler::end_frame()
+{
+    end();
+    frame_number++;
+}
+
+void GPUProfiler::begin(const std::string& name)
+{
+    Frame& frame = frames[frame_number % frames.size()];
+    const Timing timing = { get_section(name), get_query(frame), 0 };
+    glQueryCounter(timing.begin_query, GL_TIMESTAMP);
+
+    open_timings.push_back(frame.timings.size());
+    frame.timings.push_back(timing);
+}
+
+void GPUProfiler::end()
+{
+    if (open_timings.empty()) return;
+
+    Frame& frame = frames[frame_number % frames.size()];
+    Timing& timing = frame.timings[open_timings.back()];
+    open_timings.pop_back();
+
+    timing.end_query = get_query(frame);
+    glQueryCounter(timing.end_query, GL_TIMESTAMP);
+}
+
+unsigned int GPUProfiler::get_section(const std::string& name)
+{
+    // Sections are told apart by name alone, and keep the depth they were first seen at
+    for (unsigned int i = 0; i < sections.size(); ++i)
+        if (sections[i].name == name)
+            return i;
+
+    sections.push_back({ .name = name, .depth = (unsigned int)open_timings.size() });
+    return sections.size() - 1;
+}
+
+unsigned int GPUProfiler::get_query(Frame& frame)
+{
+    if (frame.queries_used == frame.queries.size())
+    {
+        unsigned int query;
+        glGenQueries(1, &query);
+        frame.queries.push_back(query);
+    }
+    return frame.queries[frame.queries_used++];
+}
+
+void GPUProfiler::collect(Frame& frame)
+{
+    if (frame.timings.empty() || frame.timings.front().end_query == 0) return;
+
+    // Timestamps complete in order, so the whole frame's (which ends last)
+    // tells us about the rest - if even that isn't ready, give up on the frame
+    // rather than wait
+    int available = 0;
+    glGetQueryObjectiv(frame.timings.front().end_query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+    {
+        dropped_frames++;
+        return;
+    }
+
+    // A section may run more than once in a frame
+    std::vector<float> timings(sections.size(), -1.0f);
+    for (const auto& timing : frame.timings)
+    {
+        if (timing.end_query == 0) continue;
+
+        GLuint64 begin, end;
+        glGetQueryObjectui64v(timing.begin_query, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(timing.end_query, GL_QUERY_RESULT, &end);
+        timings[timing.section] = std::max(timings[timing.section], 0.0f) + (end - begin) / 1e6f;
+    }
+
+    for (unsigned int i = 0; i < sections.size(); ++i)
+    {
+        if (timings[i] < 0.0f) continue;
+
+        Section& section = sections[i];
+        section.history[section.samples++ % section.history.size()] = timings[i];
+
+        const unsigned int count = std::min<unsigned int>(section.samples, section.history.size());
+        float total = 0.0f;
+        section.max = 0.0f;
+        for (unsigned int j = 0; j < count; ++j)
+        {
+            total += section.history[j];
+            section.max = std::max(section.max, section.history[j]);
+        }
+        section.average = total / count;
+    }
+
+    if (recording) recorded.push_back({ frame.number, std::move(timings) });
+}
+
+void GPUProfiler::draw_gui()
+{
+    ImGui::Begin("GPU profiler");
+    if (ImGui::Button(recording ? "Stop recording" : "Record to " GPU_PROFILER_CSV))
+    {
+        if (recording) write_csv(GPU_PROFILER_CSV);
+        recording = !recording;
+        recorded.clear();
+    }
+    if (recording)
+    {
+        ImGui::SameLine();
+        ImGui::Text("%zu frames", recorded.size());
+    }
+    ImGui::Text("Dropped frames: %u", dropped_frames);
+
+    if (ImGui::BeginTable("sections", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+    {
+        ImGui::TableSetupColumn("Section");
+        ImGui::TableSetupColumn("Average (ms)");
+        ImGui::TableSetupColumn("Max (ms)");
+        ImGui::TableHeadersRow();
+        for (const auto& section : sections)
+        {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%*s%s", section.depth * 2, "", section.name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", section.average);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", section.max);
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
+
+void GPUProfiler::write_csv(const std::string& filename) const
+{
+    std::ofstream out(filename);
+    if (!out)
+    {
+        std::cerr << "unable to write GPU profile " << filename << std::endl;
+        return;
+    }
+
+    // Sections first seen part way through recording are blank until then
+    out << "frame";
+    for (const auto& section : sections) out << "," << section.name;
+    out << "\n";
+
+    for (const auto& row : recorded)
+    {
+        out << row.frame;
+        for (unsigned int i = 0; i < sections.size(); ++i)
+        {
+            out << ",";
+            if (i < row.timings.size() && row.timings[i] >= 0.0f) out << row.timings[i];
+        }
+        out << "\n";
+    }
+    std::cout << "wrote " << recorded.size() << " frames of GPU timings to " << filename << std::endl;
+}
@@ -0,0 +1,58 @@
+#include "instance_buffer.h"
+#include <glad/glad.h>
+#include <stdexcept>
+
+InstanceBuffer::InstanceBuffer(const uint32_t capacity) : capacity(capacity)
+{
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceBuffer::bind_attributes() const
+{
+    // A mat4 attribute takes up four vec4 slots
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        const unsigned int attribute = first_attribute + i;
+        glVertexAttribPointer(attribute, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4) * i));
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribDivisor(attribute, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+uint32_t InstanceBuffer::upload(const std::vector<glm::mat4>& transforms)
+{
+    if (transforms.size() > capacity)
+        throw std::runtime_error("too many instances for instance buffer");
+
+    // Out of room, so orphan the old storage (draws still using it keep it
+    // alive) and start again from the beginning
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    if (cursor + transforms.size() > capacity)
+    {
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+        cursor = 0;
+    }
+
+    const uint32_t base_instance = cursor;
+    if (!transforms.empty())
+        glBufferSubData(
+            GL_ARRAY_BUFFER,
+            base_instance * sizeof(glm::mat4),
+            transforms.size() * sizeof(glm::mat4),
+            transforms.data()
+        );
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    cursor += transforms.size();
+    return base_instance;
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+    glDeleteBuffers(1, &vbo);
+}
@@ -1,16 +1,38 @@
 #include "renderer.h"
 #include <iostream>
+#include <cstdio>
+#include <cstring>
 
 constexpr int width = 1600;
 constexpr int height = 900;
 
+// --headless WIDTHxHEIGHT renders offscreen (no window or display needed),
+// --frames N quits after N frames, and --screenshot FILE then saves the last
+// one (headless only) as a PPM
+struct Options
+{
+    bool headless = false;
+    int width = ::width;
+    int height = ::height;
+    unsigned int frames = 0;
+    std::string screenshot;
+};
+
 Scene chunk_scene();
 Scene sponza_scene();
 void chunk_loop(Scene& scene, const Window& window);
+bool parse_options(const int argc, char** argv, Options& options);
 
-int main()
+int main(int argc, char** argv)
 {
-    Renderer renderer("gl", width, height, RENDER_SCALE);
+    Options options;
+    if (!parse_options(argc, argv, options))
+    {
+        std::cerr << "usage: " << argv[0] << " [--headless WIDTHxHEIGHT] [--frames N] [--screenshot FILE]" << std::endl;
+        return 1;
+    }
+
+    Renderer renderer("gl", options.width, options.height, RENDER_SCALE, options.headless);
     Window& window = renderer.window;
     window.capture_mouse();
 
@@ -21,13 +43,16 @@ int main()
     // Seutp scene
     Scene scene = sponza_scene();
     auto* camera = &scene.camera;
-    double time = glfwGetTime();
+    double time = window.get_time();
+    unsigned int frame = 0;
 
     while (renderer.update(scene))
     {
-        // Delta time
-        const double new_time = glfwGetTime();
-        const double delta = new_time - time;
+        if (options.frames && ++frame >= options.frames) break;
+
+        // Delta time (fixed when headless, so runs are repeatable)
+        const double new_time = window.get_time();
+        const double delta = options.headless ? 1.0 / 60.0 : new_time - time;
         time = new_time;
 
         // Water waves
@@ -83,9 +108,41 @@ int main()
         //chunk_loop(scene, window);
     }
 
+    if (!options.screenshot.empty()) window.save_screenshot(options.screenshot);
+
     return 0;
 }
 
+bool parse_options(const int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        // Every option takes a value
+        if (i + 1 >= argc) return false;
+        const char* value = argv[++i];
+
+        if (std::strcmp(argv[i - 1], "--headless") == 0)
+        {
+            options.headless = true;
+            if (std::sscanf(value, "%dx%d", &options.width, &options.height) != 2) return false;
+            if (options.width < HEADLESS_MIN_SIZE || options.height < HEADLESS_MIN_SIZE)
+            {
+                std::cerr << "headless size must be at least " << HEADLESS_MIN_SIZE << "x" << HEADLESS_MIN_SIZE << std::endl;
+                return false;
+            }
+        }
+        else if (std::strcmp(argv[i - 1], "--frames") == 0)
+        {
+            if (std::sscanf(value, "%u", &options.frames) != 1) return false;
+        }
+        else if (std::strcmp(argv[i - 1], "--screenshot") == 0) options.screenshot = value;
+        else return false;
+    }
+
+    // Windows' default framebuffer is gone by the time we'd read it back
+    return options.screenshot.empty() || options.headless;
+}
+
 Scene chunk_scene()
 {
     Scene scene =
@@ -113,17 +170,15 @@ Scene chunk_scene()
     scene.sun.colour *= 0.8f;
 
     auto& monkey = scene.entities[0];
-    monkey.transform.position = { 15, 15, 15 };
+    monkey.transform.set_position({ 15, 15, 15 });
 
     auto& crosshair = scene.sprites[0];
-    crosshair.transform.scale = glm::vec3(0.02f);
+    crosshair.transform.set_scale(glm::vec3(0.02f));
 
     // Water and positioning
     auto& water = scene.waters[0];
-    water.transform.scale *= 100.0f;
-    water.transform.position.y = 5.0f;
-    water.transform.position.x = Chunk::size * 2;
-    water.transform.position.z = Chunk::size * 2;
+    water.transform.set_scale(water.transform.get_scale() * 100.0f);
+    water.transform.set_position({ Chunk::size * 2, 5.0f, Chunk::size * 2 });
     scene.camera.position.x = Chunk::size * 2;
     scene.camera.position.z = Chunk::size * 2;
     scene.camera.position.y = 20;
@@ -162,15 +217,14 @@ Scene sponza_scene()
 
     // Position sponza model
     auto* sponza = &scene.entities[0];
-    sponza->transform.scale = glm::vec3(0.01f);
-    sponza->transform.position.y = -1;
-    sponza->transform.position.z = 1;
-    sponza->transform.rotation.y = 90;
+    sponza->transform.set_scale(glm::vec3(0.01f));
+    sponza->transform.set_position({ 0.0f, -1.0f, 1.0f });
+    sponza->transform.set_rotation(glm::vec3 { 0.0f, 90.0f, 0.0f });
 
     // Water and positioning
     auto& water = scene.waters[0];
-    water.transform.scale *= 100.0f;
-    water.transform.position = { 0.0f, 0.0f, 0.0f };
+    water.transform.set_scale(water.transform.get_scale() * 100.0f);
+    water.transform.set_position({ 0.0f, 0.0f, 0.0f });
 
     return scene;
 }
@@ -1,6 +1,8 @@
 #include "mesh.h"
 #include "cube.h"
 #include "quad.h"
+#include "resources.h"
+#include "gl_state.h"
 #include <glad/glad.h>
 #include <stdexcept>
 
@@ -14,7 +16,7 @@ Mesh::Mesh(
 {
     // Create and bind VAO
     glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    gl_state::bind_vertex_array(vao);
 
     // Create, bind and upload indices' element buffer object (EBO)
     glGenBuffers(1, &ebo);
@@ -27,9 +29,15 @@ Mesh::Mesh(
     if (normals.has_value()) make_vao(2, GL_FLOAT, 3, normals.value());
     if (tangents.has_value()) make_vao(3, GL_FLOAT, 3, tangents.value());
 
+    // Per-instance transforms
+    if (instance_buffer) instance_buffer->bind_attributes();
+
     // Unbind VAO but *not* EBO (as this is bound by the VAO for us)
-    glBindVertexArray(0);
+    gl_state::bind_vertex_array(0);
     this->indices = indices.size();
+
+    bounds = AABB::from_vertices(vertices);
+    bounding_sphere = bounding_sphere_from_vertices(vertices, bounds);
 }
 
 Mesh* Mesh::quad()
@@ -66,12 +74,12 @@ void Mesh::make_vao(
 
 void Mesh::bind() const
 {
-    glBindVertexArray(vao);
+    gl_state::bind_vertex_array(vao);
 }
 
 void Mesh::unbind() const
 {
-    glBindVertexArray(0);
+    gl_state::bind_vertex_array(0);
 }
 
 void Mesh::draw() const
@@ -79,8 +87,14 @@ void Mesh::draw() const
     glDrawElements(GL_TRIANGLES, indices, GL_UNSIGNED_INT, 0);
 }
 
+void Mesh::draw_instanced(const uint32_t count, const uint32_t base_instance) const
+{
+    glDrawElementsInstancedBaseInstance(GL_TRIANGLES, indices, GL_UNSIGNED_INT, 0, count, base_instance);
+}
+
 Mesh::~Mesh()
 {
+    gl_state::forget_vertex_array(vao);
     glDeleteVertexArrays(1, &vao);
     for (const auto vbo: vbos)
         glDeleteBuffers(1, &vbo);
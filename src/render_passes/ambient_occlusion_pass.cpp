@@ -1,16 +1,23 @@
 #include "render_passes/render_passes.h"
+#include "cpu_profiler.h"
 #include <random>
 
 AmbientOcclusionPass::AmbientOcclusionPass(const unsigned int width, const unsigned int height) :
     RenderPass(),
     output_framebuffer(width, height, Framebuffer::DepthSettings::NO_DEPTH, false, true),
-    blur_pass(width, height)
+    blur_pass(width, height),
+    half_framebuffers {
+        Framebuffer(std::max(width / 2, 1u), std::max(height / 2, 1u), Framebuffer::DepthSettings::NO_DEPTH, false, true),
+        Framebuffer(std::max(width / 2, 1u), std::max(height / 2, 1u), Framebuffer::DepthSettings::NO_DEPTH, false, true)
+    }
 {
+    for (auto& framebuffer : half_framebuffers)
+        framebuffer.colour_texture->clamp(glm::vec4(1.0f), false);
+
     shader.bind();
-    shader.set_uniform("position",  0);
-    shader.set_uniform("normal",    1);
-    shader.set_uniform("depth",     2);
-    shader.set_uniform("noise",     3);
+    shader.set_uniform("normal",    0);
+    shader.set_uniform("depth",     1);
+    shader.set_uniform("noise",     2);
 
     const auto lerp = [](const float a, const float b, const float f)
     {
@@ -54,37 +61,51 @@ AmbientOcclusionPass::AmbientOcclusionPass(const unsigned int width, const unsig
     }
 
     noise = new Texture(noise_size, noise_size, GL_RGB16F, GL_RGB, GL_FLOAT, true, (char*)&noises[0]);
-    shader.set_uniform("noise_scale", glm::vec2 {
-        (float)width / (float)noise_size,
-        (float)height / (float)noise_size
-    });
+    this->noise_size = { (float)noise_size, (float)noise_size };
+
+    uniforms.radius = shader.get_uniform<float>("radius");
+    uniforms.bias = shader.get_uniform<float>("bias");
+    uniforms.sharpness = shader.get_uniform<float>("sharpness");
+    uniforms.noise_scale = shader.get_uniform<glm::vec2>("noise_scale");
+
+    bilateral_blur_shader.bind();
+    bilateral_blur_shader.set_uniform("image", 0);
+    bilateral_blur_shader.set_uniform("depth", 1);
+    uniforms.horizontal = bilateral_blur_shader.get_uniform<int>("horizontal");
+
+    bilateral_upsample_shader.bind();
+    bilateral_upsample_shader.set_uniform("image", 0);
+    bilateral_upsample_shader.set_uniform("depth", 1);
 }
 
 void AmbientOcclusionPass::render(
-    const Texture& positions,
     const Texture& normals,
-    const Texture& depth,
-    const glm::mat4& view,
-    const glm::mat4& projection
+    const Texture& depth
 )
 {
-    output_framebuffer.bind();
-    shader.bind();
-
+    PROFILE_ZONE("AmbientOcclusionPass::render");
     // ImGui - for a more moderate effect use 0.5f for radius and 1.0f for sharpness
     static float radius = 2.0f;
     static float bias = 0.025f;
     static float sharpness = 2.0f;
     static bool enabled = true;
+    static bool half_resolution = true;
     ImGui::Begin("SSAO");
     ImGui::SliderFloat("Radius", &radius, 0.0f, 10.0);
     ImGui::SliderFloat("Bias", &bias, 0.0f, 1.0);
     ImGui::SliderFloat("Sharpness", &sharpness, 0.0f, 10.0);
     ImGui::Checkbox("Enabled", &enabled);
+    ImGui::Checkbox("Half resolution", &half_resolution);
     ImGui::End();
 
+    // A quarter of the pixels - depth and normals are just point sampled
+    const Framebuffer& target = half_resolution ? half_framebuffers[0] : output_framebuffer;
+    target.bind();
+    shader.bind();
+
     if (!enabled)
     {
+        output_framebuffer.bind();
         glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -92,22 +113,44 @@ void AmbientOcclusionPass::render(
     }
 
     // Textures
-    positions.bind(0);
-    normals.bind(1);
-    depth.bind(2);
-    noise->bind(3);
+    normals.bind(0);
+    depth.bind(1);
+    noise->bind(2);
 
     // Uniforms
-    shader.set_uniform("view", view);
-    shader.set_uniform("projection", projection);
-    shader.set_uniform("radius", radius);
-    shader.set_uniform("bias", bias);
-    shader.set_uniform("sharpness", sharpness);
+    shader.set_uniform(uniforms.radius, radius);
+    shader.set_uniform(uniforms.bias, bias);
+    shader.set_uniform(uniforms.sharpness, sharpness);
+    shader.set_uniform(uniforms.noise_scale, glm::vec2(target.width, target.height) / noise_size);
 
     quad_mesh->draw();
 
     // Blur
-    blur_pass.render(&output_framebuffer.colour_texture.value(), &output_framebuffer);
+    if (half_resolution) render_half_resolution(depth);
+    else blur_pass.render(*output_framebuffer.colour_texture, &output_framebuffer);
+}
+
+void AmbientOcclusionPass::render_half_resolution(const Texture& depth)
+{
+    // Depth-aware blur, so occlusion doesn't leak onto whatever's in front
+    bilateral_blur_shader.bind();
+    depth.bind(1);
+
+    half_framebuffers[1].bind();
+    half_framebuffers[0].colour_texture->bind(0);
+    bilateral_blur_shader.set_uniform(uniforms.horizontal, true);
+    quad_mesh->draw();
+
+    half_framebuffers[0].bind();
+    half_framebuffers[1].colour_texture->bind(0);
+    bilateral_blur_shader.set_uniform(uniforms.horizontal, false);
+    quad_mesh->draw();
+
+    // Back up to full resolution without blurring across edges
+    output_framebuffer.bind();
+    bilateral_upsample_shader.bind();
+    half_framebuffers[0].colour_texture->bind(0);
+    quad_mesh->draw();
 }
 
 AmbientOcclusionPass::~AmbientOcclusionPass()
@@ -1,30 +1,80 @@
 #include "render_passes/render_passes.h"
+#include "cpu_profiler.h"
+#include "config.h"
+#include <algorithm>
 
-BloomPass::BloomPass(const unsigned int width, const unsigned int height) :
-    RenderPass(),
-    blur_pass(width, height)
+static_assert(BLOOM_MIPS > 0, "bloom needs at least one level");
+
+BloomPass::BloomPass(const unsigned int width, const unsigned int height) : RenderPass()
 {
-    bloom_shader.bind();
-    bloom_shader.set_uniform("threshold", 0.7f);
+    // Stop early rather than go below a couple of pixels - but always have at
+    // least one level, as that's the output
+    unsigned int mip_width = std::max(width, 1u);
+    unsigned int mip_height = std::max(height, 1u);
+    for (unsigned int i = 0; i < BLOOM_MIPS && (i == 0 || (mip_width >= 2 && mip_height >= 2)); ++i)
+    {
+        mips.emplace_back(std::make_unique<Framebuffer>(mip_width, mip_height));
+        mips.back()->colour_texture->clamp(glm::vec4(0.0f), false);
+        mip_width /= 2;
+        mip_height /= 2;
+    }
+
+    downsample_shader.bind();
+    downsample_shader.set_uniform("image", 0);
+    uniforms.prefilter = downsample_shader.get_uniform<int>("prefilter");
+    uniforms.threshold = downsample_shader.get_uniform<float>("threshold");
+    uniforms.intensity = downsample_shader.get_uniform<float>("intensity");
+
+    upsample_shader.bind();
+    upsample_shader.set_uniform("image", 0);
+    uniforms.radius = upsample_shader.get_uniform<float>("radius");
 }
 
 void BloomPass::render(const Texture& texture)
 {
-    // Use blur pass's framebuffer because it's the same size as ours
-    // and won't break anything :)
-    blur_pass.get_default_input().bind();
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    // Extract bright parts of image
-    bloom_shader.bind();
-    texture.bind();
-    quad_mesh->draw();
-
-    // Blur
-    blur_pass.render();
+    PROFILE_ZONE("BloomPass::render");
+    static float threshold = 0.7f;
+    static float radius = 1.0f;
+    ImGui::Begin("Bloom");
+    ImGui::SliderFloat("Threshold", &threshold, 0.0f, 5.0f);
+    ImGui::SliderFloat("Radius", &radius, 0.5f, 3.0f);
+    ImGui::Text("Levels: %zu", mips.size());
+    ImGui::End();
+
+    // Downsample - the first level also picks out what's bright enough, and as
+    // every level ends up added together, scales it so the total stays the same
+    downsample_shader.bind();
+    downsample_shader.set_uniform(uniforms.threshold, threshold);
+    downsample_shader.set_uniform(uniforms.intensity, 1.0f / mips.size());
+
+    const Texture* input = &texture;
+    for (size_t i = 0; i < mips.size(); ++i)
+    {
+        mips[i]->bind();
+        input->bind();
+        downsample_shader.set_uniform(uniforms.prefilter, i == 0);
+        quad_mesh->draw();
+        input = &mips[i]->colour_texture.value();
+    }
+
+    // Upsample, accumulating each level onto the (larger) one above it
+    upsample_shader.bind();
+    upsample_shader.set_uniform(uniforms.radius, radius);
+    gl_state::set_enabled(GL_BLEND, true);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    for (size_t i = mips.size() - 1; i > 0; --i)
+    {
+        mips[i - 1]->bind();
+        mips[i]->colour_texture->bind();
+        quad_mesh->draw();
+    }
+
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl_state::set_enabled(GL_BLEND, false);
 }
 
 Framebuffer& BloomPass::get_output()
 {
-    return blur_pass.get_default_output();
+    return *mips.front();
 }
@@ -1,4 +1,44 @@
 #include "render_passes/render_passes.h"
+#include "cpu_profiler.h"
+#include "config.h"
+#include <array>
+
+// Must match blur.comp
+constexpr int max_blur_radius = 16;
+constexpr unsigned int blur_tile_size = 128;
+static_assert(BLUR_RADIUS > 0 && BLUR_RADIUS <= max_blur_radius, "unsupported blur radius");
+
+// std::exp isn't constexpr, but a few terms of its series are plenty here
+static constexpr double constexpr_exp(const double x)
+{
+    double result = 1.0;
+    double term = 1.0;
+    for (int i = 1; i < 64; ++i)
+    {
+        term *= x / i;
+        result += term;
+    }
+    return result;
+}
+
+// One side of a normalised Gaussian kernel (centre first), built at compile time
+static constexpr std::array<float, BLUR_RADIUS + 1> gaussian_weights(const float sigma)
+{
+    std::array<double, BLUR_RADIUS + 1> weights = {};
+    double total = 0.0;
+    for (int i = 0; i <= BLUR_RADIUS; ++i)
+    {
+        weights[i] = constexpr_exp(-(i * i) / (2.0 * sigma * sigma));
+        total += (i == 0) ? weights[i] : weights[i] * 2.0;
+    }
+
+    std::array<float, BLUR_RADIUS + 1> normalised = {};
+    for (int i = 0; i <= BLUR_RADIUS; ++i)
+        normalised[i] = float(weights[i] / total);
+    return normalised;
+}
+
+constexpr auto blur_weights = gaussian_weights(BLUR_SIGMA);
 
 BlurPass::BlurPass(const unsigned int width, const unsigned int height) :
     RenderPass(),
@@ -9,46 +49,48 @@ BlurPass::BlurPass(const unsigned int width, const unsigned int height) :
 {
     framebuffers[0].colour_texture->clamp(glm::vec4(0.0f), false);
     framebuffers[1].colour_texture->clamp(glm::vec4(0.0f), false);
+
+    shader.bind();
+    shader.set_uniform("image", 0);
+    shader.set_uniform("radius", BLUR_RADIUS);
+    for (int i = 0; i <= BLUR_RADIUS; ++i)
+        shader.set_uniform("weights[" + std::to_string(i) + "]", blur_weights[i]);
+
+    uniforms.horizontal = shader.get_uniform<int>("horizontal");
 }
 
-void BlurPass::render(const std::optional<Texture*> texture, std::optional<Framebuffer*> output)
+void BlurPass::render(const Texture& input, std::optional<Framebuffer*> output)
 {
+    PROFILE_ZONE("BlurPass::render");
+    // One wider kernel in each direction rather than two passes of a narrower
+    // one - the intermediate always goes through our own framebuffer
+    const Texture& result = output.has_value() ? *(*output)->colour_texture : *get_default_output().colour_texture;
+
     shader.bind();
-    quad_mesh->bind();
-
-    // Horizontal
-    if (texture.has_value()) (*texture)->bind();
-    else get_default_input().colour_texture->bind();
-    framebuffers[0].bind();
-    shader.set_uniform("horizontal", true);
-    quad_mesh->draw();
-
-    // Vertical
-    framebuffers[1].bind();
-    framebuffers[0].colour_texture->bind();
-    shader.set_uniform("horizontal", false);
-    quad_mesh->draw();
-
-    // Horizontal
-    framebuffers[0].bind();
-    framebuffers[1].colour_texture->bind();
-    shader.set_uniform("horizontal", true);
-    quad_mesh->draw();
-
-    // Final vertical
-    if (output.has_value()) (*output)->bind();
-    else framebuffers[1].bind();
-    framebuffers[0].colour_texture->bind();
-    shader.set_uniform("horizontal", false);
-    quad_mesh->draw();
+    dispatch(input, *framebuffers[0].colour_texture, true);
+    dispatch(*framebuffers[0].colour_texture, result, false);
+
+    // Whatever's next may also render on top of the result
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
 }
 
-Framebuffer& BlurPass::get_default_input()
+void BlurPass::dispatch(const Texture& input, const Texture& output, const bool horizontal)
 {
-    return framebuffers[1];
+    input.bind(0);
+    output.bind_image(output.get_internal_format(), GL_WRITE_ONLY);
+    shader.set_uniform(uniforms.horizontal, horizontal);
+
+    const unsigned int width = framebuffers[0].width;
+    const unsigned int height = framebuffers[0].height;
+    const unsigned int length = horizontal ? width : height;
+    const unsigned int lines = horizontal ? height : width;
+    glDispatchCompute((length + blur_tile_size - 1) / blur_tile_size, lines, 1);
+
+    // Next pass (or whoever) samples what this one wrote
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
 }
 
 Framebuffer& BlurPass::get_default_output()
 {
     return framebuffers[1];
-}
\ No newline at end of file
+}
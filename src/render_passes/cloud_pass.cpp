@@ -1,74 +1,88 @@
 #include "render_passes/render_passes.h"
+#include "cpu_profiler.h"
+#include "cloud_noise.h"
+
+// Pixels traced per frame are 1 / (trace_block * trace_block), in an ordered
+// dither so that each frame's are spread evenly between the last
+constexpr unsigned int trace_block = 4;
+constexpr unsigned int trace_order[trace_block * trace_block] =
+{
+    0, 10, 2, 8, 5, 15, 7, 13, 1, 11, 3, 9, 4, 14, 6, 12
+};
 
 CloudPass::CloudPass(const unsigned int width, const unsigned int height) :
     RenderPass(),
-    output_framebuffer(width, height),
-    blur_pass(width, height)
+    trace_framebuffer((width + trace_block - 1) / trace_block, (height + trace_block - 1) / trace_block),
+    history_framebuffers {
+        Framebuffer(width, height),
+        Framebuffer(width, height)
+    },
+    shadow_framebuffer(CLOUD_SHADOW_RESOLUTION, CLOUD_SHADOW_RESOLUTION, Framebuffer::DepthSettings::NO_DEPTH, false, true),
+    shadow_view("Cloud shadows", 2.0f)
 {
-    cloud_shader.bind();
+    // Nothing's shadowed outside of the area (or until clouds are enabled)
+    shadow_framebuffer.colour_texture->clamp(glm::vec4(1.0f), true);
+    shadow_framebuffer.bind();
+    glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    trace_framebuffer.colour_texture->clamp(glm::vec4(0.0f), false);
+    for (auto& framebuffer : history_framebuffers)
+        framebuffer.colour_texture->clamp(glm::vec4(0.0f), false);
+
     cloud_shader.bind();
     cloud_shader.set_uniform("noise_map",       0);
     cloud_shader.set_uniform("detail_map",      1);
     cloud_shader.set_uniform("depth_map",       2);
-    cloud_shader.set_uniform("z_near",          z_near);
-    cloud_shader.set_uniform("z_far",           z_far);
+    cloud_shader.set_uniform("screen_size",     glm::vec2 { width, height });
+    cloud_shader.set_uniform("trace_block",     (float)trace_block);
+
+    density_uniforms = get_density_uniforms(cloud_shader);
+    uniforms.trace_offset = cloud_shader.get_uniform<glm::vec2>("trace_offset");
+    uniforms.jitter = cloud_shader.get_uniform<float>("jitter");
+    uniforms.brightness = cloud_shader.get_uniform<float>("brightness");
+    uniforms.steps = cloud_shader.get_uniform<int>("steps");
+
+    reproject_shader.bind();
+    reproject_shader.set_uniform("trace",       0);
+    reproject_shader.set_uniform("history",     1);
+    reproject_shader.set_uniform("screen_size", glm::vec2 { width, height });
+    reproject_shader.set_uniform("trace_block", (float)trace_block);
+    uniforms.reproject_bounds_min = reproject_shader.get_uniform<glm::vec3>("bounds_min");
+    uniforms.reproject_bounds_max = reproject_shader.get_uniform<glm::vec3>("bounds_max");
+    uniforms.reproject_trace_offset = reproject_shader.get_uniform<glm::vec2>("trace_offset");
+    uniforms.history_valid = reproject_shader.get_uniform<int>("history_valid");
+
+    shadow_shader.bind();
+    shadow_shader.set_uniform("noise_map",      0);
+    shadow_shader.set_uniform("detail_map",     1);
+    shadow_shader.set_uniform("resolution",     glm::vec2(CLOUD_SHADOW_RESOLUTION));
+    shadow_density_uniforms = get_density_uniforms(shadow_shader);
+    uniforms.shadow_density = shadow_shader.get_uniform<float>("shadow_density");
 
     init(default_texture_scale);
 }
 
 void CloudPass::init(const float scale)
 {
-    // Create texture for compute shader
-    int width = 64;
-    int height = 64;
-    int depth = 64;
-    noises[0] = new Texture(width, height, GL_R32F, GL_RED, GL_FLOAT, false, nullptr, depth);
-    noises[0]->bind_image(GL_R32F, GL_READ_WRITE);
-
-    // Generate worley noise and wait
-    worley_shader.bind();
-    worley_shader.set_uniform("output_size", glm::vec3 { width, height, depth });
-    worley_shader.set_uniform("scale", scale);
-    worley_shader.set_uniform("just_perlin", false);
-    glDispatchCompute(width, height, depth);
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-
-    // Generate high-res simplex noise
-    width = 256;
-    height = 256;
-    depth = 256;
-    noises[1] = new Texture(width, height, GL_R32F, GL_RED, GL_FLOAT, false, nullptr, depth);
-    noises[1]->bind_image(GL_R32F, GL_READ_WRITE);
-
-    // Same compute shader; different params
-    worley_shader.set_uniform("output_size", glm::vec3 { width, height, depth });
-    worley_shader.set_uniform("scale", scale * 5.0f);
-    worley_shader.set_uniform("just_perlin", true);
-    glDispatchCompute(width, height, depth);
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    // Worley noise (baked on the CPU, or loaded from a previous run)
+    const unsigned int size = 64;
+    const std::vector<float> worley = cloud_noise::load_or_generate(size, scale, false);
+    noises[0] = new Texture(size, size, GL_R32F, GL_RED, GL_FLOAT, false, (const char*)worley.data(), size);
+
+    // High-res Perlin noise - same generator; different params
+    const unsigned int detail_size = 256;
+    const std::vector<float> perlin = cloud_noise::load_or_generate(detail_size, scale * 5.0f, true);
+    noises[1] = new Texture(detail_size, detail_size, GL_R32F, GL_RED, GL_FLOAT, false, (const char*)perlin.data(), detail_size);
 }
 
-void CloudPass::render(
-    Scene& scene,
-    const glm::mat4& view,
-    const glm::mat4& projection,
-    const Texture& input_depth
-)
+void CloudPass::render(Scene& scene, const Texture& input_depth)
 {
-    // Bounds
+    PROFILE_ZONE("CloudPass::render");
     auto& cloud = scene.cloud_settings;
-    glm::vec3 min_bounds = glm::vec3(
-        scene.camera.position.x - cloud.size,
-        cloud.height_min,
-        scene.camera.position.z - cloud.size
-    );
-    glm::vec3 max_bounds = glm::vec3(
-        scene.camera.position.x + cloud.size,
-        cloud.height_max,
-        scene.camera.position.z + cloud.size
-    );
-
-    const glm::mat4 view_projection = projection * view;
+    glm::vec3 min_bounds, max_bounds;
+    get_bounds(scene, min_bounds, max_bounds);
 
     // GUI
     if (cloud.draw_debug_gui())
@@ -76,43 +90,153 @@ void CloudPass::render(
         delete noises[0];
         delete noises[1];
         init(cloud.texture_scale);
+        invalidate_history();
     }
 
+    const unsigned int index = trace_order[frame % (trace_block * trace_block)];
+    const glm::vec2 trace_offset = { index % trace_block, index / trace_block };
+
     cloud_shader.bind();
 
-    // Scene info
-    cloud_shader.set_uniform("mvp", glm::mat4(1.0f));
-    cloud_shader.set_uniform("inverse_view_projection", glm::inverse(view_projection));
-    cloud_shader.set_uniform("camera_position", scene.camera.position);
-    cloud_shader.set_uniform("bounds_min", min_bounds);
-    cloud_shader.set_uniform("bounds_max", max_bounds);
-    cloud_shader.set_uniform("screen_size", glm::vec2 {
-        output_framebuffer.width,
-        output_framebuffer.height
-    });
-    cloud_shader.set_uniform("light_colour", scene.sun.colour);
-
-    // Noise
-    cloud_shader.set_uniform("offset", cloud.time);
+    // Scene info (camera and sun come from the frame's uniform block)
+    set_density_uniforms(cloud_shader, density_uniforms, scene);
+    cloud_shader.set_uniform(uniforms.trace_offset, trace_offset);
+    cloud_shader.set_uniform(uniforms.jitter, (float)(frame % 64));
 
     // Scattering settings
-    cloud_shader.set_uniform("scale", cloud.scale);
-    cloud_shader.set_uniform("detail_scale", cloud.detail_scale);
-    cloud_shader.set_uniform("density", cloud.density);
-    cloud_shader.set_uniform("threshold", cloud.threshold);
-    cloud_shader.set_uniform("brightness", cloud.brightness);
-    cloud_shader.set_uniform("steps", cloud.steps);
-
-    // Render
-    output_framebuffer.bind();
-    glClear(GL_COLOR_BUFFER_BIT);
+    cloud_shader.set_uniform(uniforms.brightness, cloud.brightness);
+    cloud_shader.set_uniform(uniforms.steps, cloud.steps);
+
+    // Trace this frame's pixels
+    trace_framebuffer.bind();
     noises[0]->bind(0);
     noises[1]->bind(1);
     input_depth.bind(2);
     quad_mesh->bind();
     quad_mesh->draw();
 
-    blur_pass.render(&output_framebuffer.colour_texture.value(), &output_framebuffer);
+    // Fill in the rest from last frame
+    const Framebuffer& history = history_framebuffers[frame % 2];
+    frame++;
+    get_output().bind();
+    reproject_shader.bind();
+    reproject_shader.set_uniform(uniforms.reproject_bounds_min, min_bounds);
+    reproject_shader.set_uniform(uniforms.reproject_bounds_max, max_bounds);
+    reproject_shader.set_uniform(uniforms.reproject_trace_offset, trace_offset);
+    reproject_shader.set_uniform(uniforms.history_valid, history_valid);
+    trace_framebuffer.colour_texture->bind(0);
+    history.colour_texture->bind(1);
+    quad_mesh->draw();
+
+    history_valid = true;
+}
+
+void CloudPass::invalidate_history()
+{
+    history_valid = false;
+}
+
+Framebuffer& CloudPass::get_output()
+{
+    return history_framebuffers[frame % 2];
+}
+
+void CloudPass::update_shadow_area(const Scene& scene, ViewScheduler& scheduler)
+{
+    // Snapped to whole texels so the shadows don't crawl as the camera moves
+    const float size = scene.cloud_settings.size * 2.0f;
+    const float texel = size / CLOUD_SHADOW_RESOLUTION;
+    const glm::vec2 min = glm::floor((glm::vec2(scene.camera.position.x, scene.camera.position.z) - size * 0.5f) / texel) * texel;
+    next_shadow_area = { min.x, min.y, 1.0f / size, scene.cloud_settings.height_min };
+
+    // Clouds drift every frame, but only a big move (or turning them on or
+    // off) would be noticed before the next update comes round
+    const bool enabled = scene.cloud_settings.enabled;
+    const bool moved = glm::distance(glm::vec2(next_shadow_area), glm::vec2(shadow_area)) > size / 8.0f ||
+        glm::vec2(next_shadow_area.z, next_shadow_area.w) != glm::vec2(shadow_area.z, shadow_area.w);
+    scheduler.submit(shadow_view, enabled, enabled != shadows_enabled || (enabled && moved));
+}
+
+void CloudPass::render_shadows(const Scene& scene)
+{
+    PROFILE_ZONE("CloudPass::render_shadows");
+    if (!shadow_view.is_scheduled()) return;
+    shadow_area = next_shadow_area;
+    shadows_enabled = scene.cloud_settings.enabled;
+
+    shadow_view.begin_update();
+    shadow_framebuffer.bind();
+    if (!shadows_enabled)
+    {
+        glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+    else
+    {
+        shadow_shader.bind();
+        set_density_uniforms(shadow_shader, shadow_density_uniforms, scene);
+        shadow_shader.set_uniform(uniforms.shadow_density, scene.cloud_settings.shadow_density);
+        noises[0]->bind(0);
+        noises[1]->bind(1);
+        quad_mesh->draw();
+    }
+    shadow_view.end_update();
+}
+
+glm::vec4 CloudPass::get_shadow_area() const
+{
+    // Whatever the map will hold once render_shadows() is done
+    return shadow_view.is_scheduled() ? next_shadow_area : shadow_area;
+}
+
+Texture& CloudPass::get_shadows()
+{
+    return *shadow_framebuffer.colour_texture;
+}
+
+void CloudPass::get_bounds(const Scene& scene, glm::vec3& min_bounds, glm::vec3& max_bounds) const
+{
+    // Follows the camera around
+    const auto& cloud = scene.cloud_settings;
+    min_bounds = glm::vec3(
+        scene.camera.position.x - cloud.size,
+        cloud.height_min,
+        scene.camera.position.z - cloud.size
+    );
+    max_bounds = glm::vec3(
+        scene.camera.position.x + cloud.size,
+        cloud.height_max,
+        scene.camera.position.z + cloud.size
+    );
+}
+
+CloudPass::DensityUniforms CloudPass::get_density_uniforms(Shader& shader)
+{
+    return {
+        .bounds_min = shader.get_uniform<glm::vec3>("bounds_min"),
+        .bounds_max = shader.get_uniform<glm::vec3>("bounds_max"),
+        .offset = shader.get_uniform<float>("offset"),
+        .scale = shader.get_uniform<float>("scale"),
+        .detail_scale = shader.get_uniform<float>("detail_scale"),
+        .density = shader.get_uniform<float>("density"),
+        .threshold = shader.get_uniform<float>("threshold")
+    };
+}
+
+void CloudPass::set_density_uniforms(const Shader& shader, const DensityUniforms& handles, const Scene& scene) const
+{
+    glm::vec3 min_bounds, max_bounds;
+    get_bounds(scene, min_bounds, max_bounds);
+
+    const auto& cloud = scene.cloud_settings;
+    shader.set_uniform(handles.bounds_min, min_bounds);
+    shader.set_uniform(handles.bounds_max, max_bounds);
+    shader.set_uniform(handles.offset, cloud.time);
+    shader.set_uniform(handles.scale, cloud.scale);
+    shader.set_uniform(handles.detail_scale, cloud.detail_scale);
+    shader.set_uniform(handles.density, cloud.density);
+    shader.set_uniform(handles.threshold, cloud.threshold);
 }
 
 CloudPass::~CloudPass()
@@ -1,4 +1,5 @@
 #include "render_passes/render_passes.h"
+#include "cpu_profiler.h"
 
 CompositePass::CompositePass() : RenderPass()
 {
@@ -10,6 +11,7 @@ CompositePass::CompositePass() : RenderPass()
 
 void CompositePass::render(const Texture& one, const Texture& two, const Texture& three)
 {
+    PROFILE_ZONE("CompositePass::render");
     shader.bind();
     one.bind();
     two.bind(1);
@@ -1,4 +1,7 @@
 #include "render_passes/render_passes.h"
+#include "cpu_profiler.h"
+#include "imgui.h"
+#include <algorithm>
 
 GBufferPass::GBufferPass(const unsigned int width, const unsigned int height) :
     RenderPass(),
@@ -7,54 +10,135 @@ GBufferPass::GBufferPass(const unsigned int width, const unsigned int height) :
     shader.bind();
     shader.set_uniform("diffuse_map", 0);
     shader.set_uniform("normal_map",  1);
+
+    uniforms.clip_plane = shader.get_uniform<glm::vec4>("clip_plane");
+    uniforms.has_normal_map = shader.get_uniform<int>("has_normal_map");
 }
 
 void GBufferPass::render(
     const Scene& scene,
-    const glm::mat4& view,
-    const glm::mat4& projection,
+    const FrameUniforms& frame,
     const std::optional<glm::vec4> clip_plane
 )
 {
+    PROFILE_ZONE("GBufferPass::render");
     shader.bind();
     g_buffer.bind();
     glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 
     // Common uniforms
-    shader.set_uniform("view_projection", projection * view);
     if (clip_plane.has_value())
-        shader.set_uniform("clip_plane", clip_plane.value());
+        shader.set_uniform(uniforms.clip_plane, clip_plane.value());
 
-    // Entities - TODO: sort by least expensive state change
+    // Cull everything against the camera in one batch...
+    culler.clear();
     for (const auto& entity : scene.entities)
     {
-        shader.set_uniform("model", entity.transform.matrix());
+        const glm::mat4 model = entity.transform.matrix();
+        for (const auto& mesh : entity.textured_meshes)
+            culler.add(mesh.mesh->bounds.transformed(model));
+    }
+    for (const auto& chunk : scene.chunks)
+        culler.add(chunk.mesh->bounds.transformed(chunk.transform.matrix()));
+    culler.cull(frame.view_projection, visible);
+
+    // ...then gather draws for whatever survived
+    queue.clear();
+    size_t index = 0;
+    for (const auto& entity : scene.entities)
+    {
+        const glm::mat4 model = entity.transform.matrix();
 
         for (const auto& mesh : entity.textured_meshes)
         {
-            mesh.material.diffuse_texture->bind();
+            if (!visible[index++]) continue;
+
+            // Record how large this submesh's textures appear on screen so they can be
+            // streamed at the right mip - assumes a texture spans roughly one world unit,
+            // and uses the nearest point of the bounding sphere
+            const BoundingSphere sphere = mesh.mesh->bounding_sphere.transformed(model);
+            const glm::vec4 view_position = frame.view * glm::vec4(sphere.centre, 1.0f);
+            const float distance = std::max(-view_position.z - sphere.radius, z_near);
+            const float screen_size = frame.projection[1][1] * 0.5f * g_buffer.height / distance;
 
-            // Normal mapping
-            const auto& normal_map = mesh.material.normal_map;
-            shader.set_uniform("has_normal_map", normal_map.has_value());
-            if (normal_map.has_value()) normal_map.value()->bind(1);
+            mesh.material.diffuse_texture->request_screen_size(screen_size);
 
-            mesh.mesh->bind();
-            mesh.mesh->draw();
+            Texture* normal_map = nullptr;
+            if (mesh.material.normal_map.has_value())
+            {
+                normal_map = mesh.material.normal_map.value().get();
+                normal_map->request_screen_size(screen_size);
+            }
+
+            queue.push(mesh.mesh.get(), mesh.material.diffuse_texture.get(), normal_map, model, distance);
         }
     }
 
-    // Chunks
-    if (scene.chunks.size() > 0)
+    for (const auto& chunk : scene.chunks)
+    {
+        if (!visible[index++]) continue;
+
+        const glm::mat4 model = chunk.transform.matrix();
+        const float distance = -(frame.view * model * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)).z;
+        queue.push(chunk.mesh.get(), Chunk::texture.get(), nullptr, model, distance);
+    }
+    queue.stats.culled = std::count(visible.begin(), visible.end(), 0);
+
+    // ...then submit them with as few state changes as possible
+    queue.sort();
+    const uint32_t base_instance = instance_buffer->upload(queue.get_transforms());
+
+    const Mesh* bound_mesh = nullptr;
+    const Texture* bound_diffuse = nullptr;
+    const Texture* bound_normal_map = nullptr;
+    bool has_normal_map = false;
+    bool first = true;
+    queue.stats.program_binds = 1;
+
+    for (const auto& batch : queue.get_batches())
     {
-        Chunk::texture->bind();
-        shader.set_uniform("has_normal_map", false);
+        const DrawPacket& packet = *batch.packet;
+
+        if (packet.diffuse_texture != bound_diffuse)
+        {
+            packet.diffuse_texture->bind();
+            bound_diffuse = packet.diffuse_texture;
+            queue.stats.texture_binds++;
+        }
+
+        if (first || (packet.normal_map != nullptr) != has_normal_map)
+        {
+            has_normal_map = packet.normal_map != nullptr;
+            shader.set_uniform(uniforms.has_normal_map, has_normal_map);
+            queue.stats.uniform_updates++;
+        }
 
-        for (const auto& chunk : scene.chunks)
+        if (packet.normal_map && packet.normal_map != bound_normal_map)
         {
-            shader.set_uniform("model", chunk.transform.matrix());
-            chunk.mesh->bind();
-            chunk.mesh->draw();
+            packet.normal_map->bind(1);
+            bound_normal_map = packet.normal_map;
+            queue.stats.texture_binds++;
         }
+
+        if (packet.mesh != bound_mesh)
+        {
+            packet.mesh->bind();
+            bound_mesh = packet.mesh;
+            queue.stats.mesh_binds++;
+        }
+
+        packet.mesh->draw_instanced(batch.instance_count, base_instance + batch.first_instance);
+        queue.stats.draws++;
+        queue.stats.instances += batch.instance_count;
+        first = false;
     }
-}
\ No newline at end of file
+
+    ImGui::Begin("Render queue");
+    ImGui::Text("Draws: %u (%u instances)", queue.stats.draws, queue.stats.instances);
+    ImGui::Text("Culled: %u / %zu", queue.stats.culled, culler.size());
+    ImGui::Text("Program binds: %u", queue.stats.program_binds);
+    ImGui::Text("Texture binds: %u", queue.stats.texture_binds);
+    ImGui::Text("Mesh binds: %u", queue.stats.mesh_binds);
+    ImGui::Text("Uniform updates: %u", queue.stats.uniform_updates);
+    ImGui::End();
+}
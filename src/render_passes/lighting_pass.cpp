@@ -1,4 +1,5 @@
 #include "render_passes/render_passes.h"
+#include "cpu_profiler.h"
 
 LightingPass::LightingPass(const unsigned int width, const unsigned int height) :
     RenderPass(),
@@ -7,39 +8,41 @@ LightingPass::LightingPass(const unsigned int width, const unsigned int height)
     shader.bind();
     shader.set_uniform("g_albedo",   0);
     shader.set_uniform("g_normal",   1);
-    shader.set_uniform("g_position", 2);
-    shader.set_uniform("cloud_map",  3);
+    shader.set_uniform("g_depth",    2);
+    shader.set_uniform("cloud_shadow_map", 3);
     shader.set_uniform("shadow_map", 4);
     shader.set_uniform("occlusion",  5);
+    shader.set_uniform("shadow_map_compare", 6);
+    shader.set_uniform("shadow_moments", 7);
+
+    uniforms.ambient_light = shader.get_uniform<glm::vec3>("ambient_light");
 }
 
 void LightingPass::render(
     const Scene& scene,
-    const glm::mat4& light_projection,
-    const Texture* cloud_noise,
-    const Texture& shadow_map,
+    const Texture& cloud_shadows,
+    const ShadowMap& shadow_map,
     const Texture& ambient_occlusion,
     const Framebuffer& g_buffer
 )
 {
+    PROFILE_ZONE("LightingPass::render");
     output_framebuffer.bind();
 
     // Uniforms
     shader.bind();
-    shader.set_uniform("ambient_light", scene.ambient_light);
-    shader.set_uniform("light_position", scene.sun.position);
-    shader.set_uniform("light_colour", scene.sun.colour);
-    shader.set_uniform("lightspace", light_projection);
-    shader.set_uniform("cloud_scale", scene.cloud_settings.scale * 4.0f);
-    shader.set_uniform("cloud_offset", scene.cloud_settings.time);
+    shader.set_uniform(uniforms.ambient_light, scene.ambient_light);
 
     // Textures
     g_buffer.colour_texture->bind(0);
     g_buffer.normal_texture->bind(1);
-    g_buffer.position_texture->bind(2);
-    cloud_noise->bind(3);
+    g_buffer.depth_map->bind(2);
+    cloud_shadows.bind(3);
     shadow_map.bind(4);
     ambient_occlusion.bind(5);
+    shadow_map.bind_compare(6);
+    if (shadow_map.filter == ShadowFilter::EVSM) shadow_map.bind_moments(7);
 
     quad_mesh->draw();
+    shadow_map.unbind_compare(6);
 }
\ No newline at end of file
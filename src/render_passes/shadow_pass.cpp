@@ -1,45 +1,268 @@
 #include "render_passes/render_passes.h"
+#include "cpu_profiler.h"
+#include <algorithm>
+#include <limits>
 
-ShadowPass::ShadowPass() : RenderPass() {}
-
-void ShadowPass::render(
-    const Scene& scene,
-    const glm::mat4& light_projection
+// Maps the light-space box around whatever the camera can see within a cascade
+// to clip space - casters outside of it can't shadow anything visible. Only
+// the side facing away from the light matters (the culler skips the near
+// plane), and it's padded slightly for filtering.
+static glm::mat4 receiver_matrix(
+    const Camera& camera,
+    const FrameUniforms& frame,
+    const unsigned int cascade,
+    const float resolution
 )
 {
-    // Depth stuff not enabled by default
-    glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+    const float near = cascade == 0 ? z_near : frame.cascade_splits[cascade - 1];
+    const float far = frame.cascade_splits[cascade];
+    const auto corners = camera.get_frustum_corners_in_world_space(frame.screen.x, frame.screen.y, near, far);
+
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+    for (const auto& corner : corners)
+    {
+        const glm::vec4 position = frame.lightspace[cascade] * corner;
+        min = glm::min(min, glm::vec3(position) / position.w);
+        max = glm::max(max, glm::vec3(position) / position.w);
+    }
+
+    const float padding = 8.0f / resolution;
+    min -= glm::vec3(padding, padding, 0.0f);
+    max += glm::vec3(padding, padding, padding);
+
+    glm::mat4 remap = glm::mat4(1.0f);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        remap[axis][axis] = 2.0f / (max[axis] - min[axis]);
+        remap[3][axis] = -(max[axis] + min[axis]) / (max[axis] - min[axis]);
+    }
+    return remap * frame.lightspace[cascade];
+}
+
+ShadowPass::ShadowPass() : RenderPass()
+{
+    uniforms.cascade = shader.get_uniform<int>("cascade");
+
+    evsm_shader.bind();
+    evsm_shader.set_uniform("depth_map", 0);
+    evsm_shader.set_uniform("moments", 1);
+    uniforms.layer = evsm_shader.get_uniform<int>("layer");
+    uniforms.horizontal = evsm_shader.get_uniform<int>("horizontal");
+}
+
+void ShadowPass::render(const Scene& scene, const FrameUniforms& frame)
+{
+    PROFILE_ZONE("ShadowPass::render");
+    ShadowMap& shadow_map = *scene.sun.shadow_map;
+
+    bool caching = shadow_map.caching;
+    int filter = (int)shadow_map.filter;
+    ImGui::Begin("Shadows");
+    ImGui::SliderFloat("Distance", &shadow_map.distance, 10.0f, z_far);
+    ImGui::SliderFloat("Split lambda", &shadow_map.split_lambda, 0.0f, 1.0f);
+    ImGui::Checkbox("Cache static shadows", &caching);
+    ImGui::Combo("Filter", &filter, "Poisson (64 taps)\0Hardware PCF (9 taps)\0EVSM (1 tap)\0");
+    ImGui::Text("Static redraws: %u", stats.static_redraws);
+    ImGui::Text("Dynamic redraws: %u", stats.dynamic_redraws);
+    ImGui::Text("Moment updates: %u", stats.moment_updates);
+    ImGui::Text("Casters drawn: %u (%u culled)", stats.casters_drawn, stats.casters_culled);
+    ImGui::End();
+
+    if (caching != shadow_map.caching)
+    {
+        shadow_map.caching = caching;
+        shadow_map.invalidate_static();
+    }
 
-    // "Peter-panning" work-around
-    glCullFace(GL_FRONT);
+    // Moments aren't kept up to date unless they're being used
+    if ((ShadowFilter)filter != shadow_map.filter)
+    {
+        shadow_map.filter = (ShadowFilter)filter;
+        shadow_map.moments_dirty.fill(true);
+    }
 
-    // Bind state
-    scene.sun.shadow_buffer->bind();
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     shader.bind();
+    stats = {};
 
-    // Render entities
-    for (const auto& entity : scene.entities)
+    // Casters between the light and a cascade's near plane still need to land
+    // in it, so clamp rather than clip them
+    gl_state::set_enabled(GL_DEPTH_CLAMP, true);
+
+    // World-space bounds are shared by every cascade - meanwhile anything static
+    // having changed means the cached shadows are out of date
+    culler.clear();
+    is_dynamic.clear();
+    uint64_t static_signature = 14695981039346656037ull;
+    const auto hash = [&](const uint64_t value)
     {
-        shader.set_uniform("mvp", light_projection * entity.transform.matrix());
+        static_signature = (static_signature ^ value) * 1099511628211ull;
+    };
 
+    for (const auto& entity : scene.entities)
+    {
+        const glm::mat4 model = entity.transform.matrix();
         for (const auto& mesh : entity.textured_meshes)
         {
-            mesh.mesh->bind();
-            mesh.mesh->draw();
+            culler.add(mesh.mesh->bounds.transformed(model));
+            is_dynamic.push_back(!entity.is_static);
+            if (entity.is_static)
+            {
+                hash((uint64_t)mesh.mesh.get());
+                hash(entity.transform.version());
+            }
         }
     }
 
-    // Render chunks - back to normal culling!
-    glCullFace(GL_BACK);
-    if (scene.chunks.size() > 0)
+    for (const auto& chunk : scene.chunks)
     {
-        Chunk::texture->bind();
-        for (const auto& chunk : scene.chunks)
+        culler.add(chunk.mesh->bounds.transformed(chunk.transform.matrix()));
+        is_dynamic.push_back(false);
+        hash((uint64_t)chunk.mesh.get());
+        hash(chunk.transform.version());
+    }
+
+    if (static_signature != last_static_signature)
+    {
+        shadow_map.invalidate_static();
+        last_static_signature = static_signature;
+    }
+
+    for (unsigned int cascade = 0; cascade < shadow_map.cascades; ++cascade)
+    {
+        shader.set_uniform(uniforms.cascade, (int)cascade);
+        const glm::mat4 receivers = receiver_matrix(scene.camera, frame, cascade, shadow_map.resolution);
+
+        OffscreenView& view = *shadow_map.views[cascade];
+        if (!shadow_map.caching)
         {
-            shader.set_uniform("mvp", light_projection * chunk.transform.matrix());
-            chunk.mesh->bind();
-            chunk.mesh->draw();
+            culler.cull(receivers, visible, false);
+            view.begin_update();
+            shadow_map.bind_layer(cascade);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            draw_casters(scene, Casters::All);
+            view.end_update();
+            shadow_map.moments_dirty[cascade] = true;
+            stats.static_redraws++;
+            continue;
         }
+
+        // Static casters only when they (or the cascade) have changed - as they're
+        // kept while the camera turns, test against the whole cascade...
+        bool restore = false;
+        if (shadow_map.static_dirty[cascade])
+        {
+            culler.cull(frame.lightspace[cascade], visible, false);
+            view.begin_update();
+            shadow_map.bind_static_layer(cascade);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            draw_casters(scene, Casters::Static);
+            view.end_update();
+            shadow_map.static_dirty[cascade] = false;
+            stats.static_redraws++;
+            restore = true;
+        }
+
+        // ...but dynamic ones every frame, on top of a fresh copy of the static
+        // ones (which also erases where they were last frame)
+        culler.cull(receivers, visible, false);
+        bool has_dynamic_casters = false;
+        for (size_t i = 0; i < visible.size(); ++i)
+            has_dynamic_casters |= visible[i] && is_dynamic[i];
+
+        if (restore || has_dynamic_casters || shadow_map.had_dynamic_casters[cascade])
+        {
+            shadow_map.restore_static_layer(cascade);
+            shadow_map.moments_dirty[cascade] = true;
+            if (has_dynamic_casters)
+            {
+                shadow_map.bind_layer(cascade);
+                draw_casters(scene, Casters::Dynamic);
+                stats.dynamic_redraws++;
+            }
+        }
+        shadow_map.had_dynamic_casters[cascade] = has_dynamic_casters;
+    }
+
+    gl_state::set_enabled(GL_DEPTH_CLAMP, false);
+
+    if (shadow_map.filter == ShadowFilter::EVSM)
+        update_moments(shadow_map);
+}
+
+void ShadowPass::update_moments(ShadowMap& shadow_map)
+{
+    PROFILE_ZONE("ShadowPass::update_moments");
+    // Separable blur of each changed layer's moments - the horizontal pass also
+    // converts depth to moments, so needs no input of its own
+    gl_state::set_enabled(GL_DEPTH_TEST, false);
+    gl_state::set_enabled(GL_CULL_FACE, false);
+    evsm_shader.bind();
+    quad_mesh->bind();
+
+    for (unsigned int cascade = 0; cascade < shadow_map.cascades; ++cascade)
+    {
+        if (!shadow_map.moments_dirty[cascade]) continue;
+        evsm_shader.set_uniform(uniforms.layer, (int)cascade);
+
+        shadow_map.moments_scratch.bind();
+        shadow_map.bind(0);
+        evsm_shader.set_uniform(uniforms.horizontal, true);
+        quad_mesh->draw();
+
+        shadow_map.bind_moments_layer(cascade);
+        shadow_map.moments_scratch.colour_texture->bind(1);
+        evsm_shader.set_uniform(uniforms.horizontal, false);
+        quad_mesh->draw();
+
+        shadow_map.moments_dirty[cascade] = false;
+        stats.moment_updates++;
+    }
+
+    gl_state::set_enabled(GL_DEPTH_TEST, true);
+    gl_state::set_enabled(GL_CULL_FACE, true);
+}
+
+void ShadowPass::draw_casters(const Scene& scene, const Casters casters)
+{
+    PROFILE_ZONE("ShadowPass::draw_casters");
+    const auto wanted = [&](const size_t index)
+    {
+        if (!visible[index]) return false;
+        if (casters == Casters::All) return true;
+        return is_dynamic[index] == (casters == Casters::Dynamic);
+    };
+
+    // Only the mesh matters for depth, so every copy of one becomes an instance
+    // (entities and chunks are kept apart as they cull differently)
+    queue.clear();
+    size_t index = 0;
+    for (const auto& entity : scene.entities)
+    {
+        const glm::mat4 model = entity.transform.matrix();
+        for (const auto& mesh : entity.textured_meshes)
+            if (wanted(index++))
+                queue.push(mesh.mesh.get(), nullptr, nullptr, model, 0.0f, 0);
+    }
+
+    for (const auto& chunk : scene.chunks)
+        if (wanted(index++))
+            queue.push(chunk.mesh.get(), nullptr, nullptr, chunk.transform.matrix(), 0.0f, 1);
+
+    stats.casters_drawn += queue.size();
+    stats.casters_culled += std::count(visible.begin(), visible.end(), 0);
+
+    queue.sort();
+    const uint32_t base_instance = instance_buffer->upload(queue.get_transforms());
+
+    // "Peter-panning" work-around for entities - chunks are back to normal culling!
+    gl_state::cull_face(GL_FRONT);
+    for (const auto& batch : queue.get_batches())
+    {
+        if (batch.shader == 1) gl_state::cull_face(GL_BACK);
+
+        batch.packet->mesh->bind();
+        batch.packet->mesh->draw_instanced(batch.instance_count, base_instance + batch.first_instance);
     }
+    gl_state::cull_face(GL_BACK);
 }
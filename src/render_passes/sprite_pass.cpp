@@ -1,10 +1,15 @@
 #include "render_passes/render_passes.h"
+#include "cpu_profiler.h"
 
-SpritePass::SpritePass() : RenderPass() {}
+SpritePass::SpritePass() : RenderPass()
+{
+    uniforms.matrix = shader.get_uniform<glm::mat4>("matrix");
+}
 
 void SpritePass::render(const Scene& scene, const glm::mat4& projection)
 {
-    glEnable(GL_BLEND);
+    PROFILE_ZONE("SpritePass::render");
+    gl_state::set_enabled(GL_BLEND, true);
     shader.bind();
 
     // Disregard translation
@@ -14,9 +19,9 @@ void SpritePass::render(const Scene& scene, const glm::mat4& projection)
     {
         // Quad mesh already bound
         sprite.texture->bind();
-        shader.set_uniform("matrix", raw_projection * sprite.transform.matrix());
+        shader.set_uniform(uniforms.matrix, raw_projection * sprite.transform.matrix());
         quad_mesh->draw();
     }
 
-    glDisable(GL_BLEND);
+    gl_state::set_enabled(GL_BLEND, false);
 }
\ No newline at end of file
@@ -1,89 +1,125 @@
 #include "render_passes/render_passes.h"
+#include "cpu_profiler.h"
+#include "imgui.h"
 
-WaterPass::WaterPass() : RenderPass()
+// Must match depth_pyramid.comp
+constexpr unsigned int depth_pyramid_group_size = 8;
+
+WaterPass::WaterPass(const unsigned int width, const unsigned int height) :
+    RenderPass(),
+    scene_colour(width, height),
+    depth_pyramid(width, height, GL_R32F, GL_RED, GL_FLOAT, true)
 {
+    scene_colour.colour_texture->clamp(glm::vec4(0.0f), false);
+    depth_pyramid.clamp(glm::vec4(1.0f), false);
+    depth_pyramid_levels = depth_pyramid.allocate_mips();
+
     shader.bind();
-    shader.set_uniform("reflection_texture",  0);
-    shader.set_uniform("refraction_texture",  1);
-    shader.set_uniform("depth_map",           2);
-    shader.set_uniform("distortion_map",      3);
-    shader.set_uniform("normal_map",          4);
-    shader.set_uniform("z_near",              z_near);
-    shader.set_uniform("z_far",               z_far);
+    shader.set_uniform("scene_colour",      0);
+    shader.set_uniform("depth_map",         1);
+    shader.set_uniform("depth_pyramid",     2);
+    shader.set_uniform("distortion_map",    3);
+    shader.set_uniform("normal_map",        4);
+    shader.set_uniform("skybox",            5);
+    shader.set_uniform("cloud_shadow_map",  6);
+    shader.set_uniform("max_level",         (int)depth_pyramid_levels - 1);
+
+    uniforms.time = shader.get_uniform<float>("time");
+    uniforms.model = shader.get_uniform<glm::mat4>("model");
+    uniforms.has_skybox = shader.get_uniform<int>("has_skybox");
+    uniforms.sky_tint = shader.get_uniform<glm::vec3>("sky_tint");
+    uniforms.sky_colour = shader.get_uniform<glm::vec3>("sky_colour");
+    uniforms.reflections = shader.get_uniform<int>("reflections");
+    uniforms.max_distance = shader.get_uniform<float>("max_distance");
+    uniforms.thickness = shader.get_uniform<float>("thickness");
+
+    depth_pyramid_shader.bind();
+    depth_pyramid_shader.set_uniform("depth_map", 0);
+    uniforms.level = depth_pyramid_shader.get_uniform<int>("level");
 }
 
 void WaterPass::render(
     const Scene& scene,
-    const glm::mat4& view,
-    const glm::mat4& projection,
-    const glm::mat4& light_projection,
-    const Texture* cloud_noise,
+    const Framebuffer& g_buffer,
+    const Texture& cloud_shadows,
     const Framebuffer& output_framebuffer
 )
 {
-    // NOTE: clipping is used so that we can render from behind
-    // the plane, but not have "behind geometry" occluding us
-    glEnable(GL_CLIP_DISTANCE0);
-    for (const auto& water : scene.waters)
-    {
-        // Reflections: render scene normally, but to water FBOs
-        auto buffer = water.reflection_buffer;
-        buffer->bind();
-
-        // Use new view matrix, but old (normal) projection matrix
-        const glm::mat4 reflection_view = water.reflection_camera(scene.camera).view_matrix();
-        // diffuse.render(
-        //     scene,
-        //     reflection_view,
-        //     projection,
-        //     light_projection,
-        //     cloud_noise,
-        //     glm::vec4(0, 1, 0, -water.transform.position.y+0.1f)
-        //     // Add small offset to fix glitches at edges ^^
-        // );
-
-        // Refractions: much the same (but with default view matrix)
-        buffer = water.refraction_buffer;
-        buffer->bind();
-        // diffuse.render(
-        //     scene,
-        //     view,
-        //     projection,
-        //     light_projection,
-        //     cloud_noise,
-        //     glm::vec4(0, -1, 0, water.transform.position.y+0.1f)
-        //     // Add small offset to fix glitches at edges ^^
-        // );
-    }
-    glDisable(GL_CLIP_DISTANCE0);
+    PROFILE_ZONE("WaterPass::render");
+    ImGui::Begin("Water");
+    ImGui::Checkbox("Screen-space reflections", &reflections);
+    ImGui::SliderFloat("Max distance", &max_distance, 1.0f, 500.0f);
+    ImGui::SliderFloat("Thickness", &thickness, 0.01f, 10.0f);
+    ImGui::End();
+
+    if (scene.waters.empty()) return;
+
+    // Everything the water needs from the main view
+    if (reflections) build_depth_pyramid(*g_buffer.depth_map);
+    output_framebuffer.blit_colour(scene_colour);
 
-    // Reset rendering state
+    // Camera and sun come from the frame's uniform block
     output_framebuffer.bind();
     quad_mesh->bind();
-
-    // Set uniforms
     shader.bind();
-    shader.set_uniform("view", view);
-    shader.set_uniform("projection", projection);
-    shader.set_uniform("camera_position", scene.camera.position);
-    shader.set_uniform("light_position", scene.sun.position);
-    shader.set_uniform("light_colour", scene.sun.colour);
+    shader.set_uniform(uniforms.reflections, reflections);
+    shader.set_uniform(uniforms.max_distance, max_distance);
+    shader.set_uniform(uniforms.thickness, thickness);
+    shader.set_uniform(uniforms.has_skybox, scene.skybox.has_value());
+    shader.set_uniform(uniforms.sky_tint, scene.skybox_tint);
+    shader.set_uniform(uniforms.sky_colour, scene.ambient_light);
+
+    // Texture units
+    scene_colour.colour_texture->bind(0);
+    g_buffer.depth_map->bind(1);
+    depth_pyramid.bind(2);
+    if (scene.skybox.has_value()) (*scene.skybox)->bind(5);
+    cloud_shadows.bind(6);
 
     // Render water
-    glEnable(GL_BLEND);
+    gl_state::set_enabled(GL_BLEND, true);
     for (const auto& water : scene.waters)
     {
-        shader.set_uniform("time", water.time);
-        shader.set_uniform("model", water.transform.matrix());
+        shader.set_uniform(uniforms.time, water.time);
+        shader.set_uniform(uniforms.model, water.transform.matrix());
 
-        // Texture units
-        water.reflection_buffer->colour_texture->bind(0);
-        water.refraction_buffer->colour_texture->bind(1);
-        water.refraction_buffer->depth_map->bind(2);
         water.distortion_map->bind(3);
         water.normal_map->bind(4);
 
+        // Tiled across the whole plane, so always want full detail
+        water.distortion_map->request_screen_size(output_framebuffer.width);
+        water.normal_map->request_screen_size(output_framebuffer.width);
+
         quad_mesh->draw();
     }
-    glDisable(GL_BLEND);
-}
\ No newline at end of file
+    gl_state::set_enabled(GL_BLEND, false);
+}
+
+void WaterPass::build_depth_pyramid(const Texture& depth_map)
+{
+    PROFILE_ZONE("WaterPass::build_depth_pyramid");
+    depth_pyramid_shader.bind();
+    depth_map.bind(0);
+
+    unsigned int width = scene_colour.width;
+    unsigned int height = scene_colour.height;
+    for (unsigned int level = 0; level < depth_pyramid_levels; ++level)
+    {
+        // Each level reads the one before (the first, the depth buffer itself)
+        depth_pyramid.bind_image(GL_R32F, GL_READ_ONLY, 0, level == 0 ? 0 : level - 1);
+        depth_pyramid.bind_image(GL_R32F, GL_WRITE_ONLY, 1, level);
+        depth_pyramid_shader.set_uniform(uniforms.level, (int)level);
+        glDispatchCompute(
+            (width + depth_pyramid_group_size - 1) / depth_pyramid_group_size,
+            (height + depth_pyramid_group_size - 1) / depth_pyramid_group_size,
+            1
+        );
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+
+    // Sampled when tracing
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
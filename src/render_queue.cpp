@@ -0,0 +1,98 @@
+#include "render_queue.h"
+#include "cpu_profiler.h"
+#include "camera.h"
+#include <algorithm>
+
+void RenderQueue::clear()
+{
+    packets.clear();
+    entries.clear();
+    batches.clear();
+    transforms.clear();
+    material_ids.clear();
+    mesh_ids.clear();
+    stats = {};
+}
+
+void RenderQueue::push(
+    const Mesh* mesh,
+    const Texture* diffuse_texture,
+    const Texture* normal_map,
+    const glm::mat4& model,
+    const float depth,
+    const uint8_t shader
+)
+{
+    // IDs are handed out in order of first appearance
+    const auto material = material_ids.try_emplace(
+        { diffuse_texture, normal_map },
+        (uint16_t)material_ids.size()
+    ).first->second;
+    const auto mesh_id = mesh_ids.try_emplace(mesh, (uint16_t)mesh_ids.size()).first->second;
+
+    entries.push_back({ make_key(shader, material, mesh_id, depth), (uint32_t)packets.size() });
+    packets.push_back({ mesh, diffuse_texture, normal_map, model });
+}
+
+void RenderQueue::sort()
+{
+    PROFILE_ZONE("RenderQueue::sort");
+    // LSD radix sort, one byte at a time
+    scratch.resize(entries.size());
+    for (unsigned int shift = 0; shift < 64; shift += 8)
+    {
+        size_t counts[256] = {};
+        for (const auto& entry : entries)
+            counts[(entry.key >> shift) & 0xff]++;
+
+        // Every key shares this byte, so the pass wouldn't change anything
+        if (std::find(std::begin(counts), std::end(counts), entries.size()) != std::end(counts))
+            continue;
+
+        size_t offset = 0;
+        for (auto& count : counts)
+        {
+            const size_t next = offset + count;
+            count = offset;
+            offset = next;
+        }
+
+        for (const auto& entry : entries)
+            scratch[counts[(entry.key >> shift) & 0xff]++] = entry;
+        entries.swap(scratch);
+    }
+
+    // Everything above the depth bits matching means the same state
+    uint64_t batch_state = 0;
+    for (const auto& entry : entries)
+    {
+        const DrawPacket& packet = packets[entry.packet];
+        const uint64_t state = entry.key >> 24;
+
+        if (!batches.empty() && state == batch_state)
+            batches.back().instance_count++;
+        else
+        {
+            batches.push_back({ &packet, uint8_t(entry.key >> 56), (uint32_t)transforms.size(), 1 });
+            batch_state = state;
+        }
+
+        transforms.push_back(packet.model);
+    }
+}
+
+uint64_t RenderQueue::make_key(
+    const uint8_t shader,
+    const uint16_t material,
+    const uint16_t mesh,
+    const float depth
+)
+{
+    const float normalised_depth = std::clamp(depth / z_far, 0.0f, 1.0f);
+    const uint64_t quantised_depth = uint64_t(normalised_depth * float(0xffffff));
+
+    return (uint64_t(shader) << 56) |
+        (uint64_t(material) << 40) |
+        (uint64_t(mesh) << 24) |
+        quantised_depth;
+}
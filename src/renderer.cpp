@@ -1,22 +1,27 @@
 #include "renderer.h"
 #include "resources.h"
+#include "gl_state.h"
+#include "cpu_profiler.h"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 #include <iostream>
+#include <algorithm>
 
-Renderer::Renderer(const std::string& title, const int width, const int height, const float render_scale) :
-    window(title, width, height),
+Renderer::Renderer(const std::string& title, const int width, const int height, const float render_scale, const bool headless) :
+    window(title, width, height, headless),
     render_scale(render_scale),
     g_buffer_pass(render_width(), render_height()),
     lighting_pass(render_width(), render_height()),
     ao_pass(render_width(), render_height()),
+    water_pass(render_width(), render_height()),
     bloom_pass(render_width() / 2, render_height() / 2),
-    cloud_pass(render_width() / 2, render_height() / 2)
+    cloud_pass(render_width() / 2, render_height() / 2),
+    frame_uniform_buffer(sizeof(FrameUniforms), UniformBlockBinding::FrameBlock)
 {
     // Setup GL state
-    glCullFace(GL_BACK);
-    glViewport(0, 0, render_width(), render_height());
+    gl_state::cull_face(GL_BACK);
+    gl_state::viewport(0, 0, render_width(), render_height());
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
     // For water soft edges
@@ -25,110 +30,174 @@ Renderer::Renderer(const std::string& title, const int width, const int height,
     // Init ImGui
     ImGui::CreateContext();
     ImGui::StyleColorsDark();
-    ImGui_ImplGlfw_InitForOpenGL(window.window, true);
+    if (!window.headless) ImGui_ImplGlfw_InitForOpenGL(window.window, true);
     ImGui_ImplOpenGL3_Init("#version 150");
 
     init_resources();
+
+    std::cout << "shaders loaded in " << Shader::total_load_time * 1000.0 << " ms ("
+              << Shader::cache_hits << " cached, " << Shader::cache_misses << " compiled)" << std::endl;
 }
 
 bool Renderer::update(Scene& scene)
 {
+    // Everything since the last update (including the caller's) was one frame
+    cpu_profiler::end_frame();
+    PROFILE_ZONE("Renderer::update");
+
     // Update window; poll events
-    double start = glfwGetTime();
+    double start = window.get_time();
     if (!window.update()) return false;
 
     // ImGui
-    ImGui_ImplOpenGL3_NewFrame();
-    ImGui_ImplGlfw_NewFrame();
-    ImGui::NewFrame();
+    {
+        PROFILE_ZONE("ImGui::NewFrame");
+        ImGui_ImplOpenGL3_NewFrame();
+        if (window.headless)
+        {
+            // What the GLFW backend would otherwise fill in
+            ImGuiIO& io = ImGui::GetIO();
+            io.DisplaySize = ImVec2(window.framebuffer_width, window.framebuffer_height);
+            io.DeltaTime = std::max(float(start - last_frame_time), 1e-4f);
+            last_frame_time = start;
+        }
+        else ImGui_ImplGlfw_NewFrame();
+        ImGui::NewFrame();
+    }
+    gpu_profiler.begin_frame();
 
-    // Compute matrices
+    // Compute matrices (only those that have changed)
+    update_transforms();
     const auto view = scene.camera.view_matrix();
     const auto projection = scene.camera.projection_matrix(render_width(), render_height());
-    const auto light_projection = scene.sun.get_light_projection_matrix(scene.camera, render_width(), render_height());
 
-    // Enable culling, etc.
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
+    // Offscreen views say what's gone stale, then the budget decides what gets
+    // updated this frame
+    {
+        PROFILE_ZONE("Offscreen views");
+        scene.sun.shadow_map->update_cascades(scene.camera, scene.sun.position, render_width(), render_height(), view_scheduler);
+        cloud_pass.update_shadow_area(scene, view_scheduler);
+        view_scheduler.schedule();
+        view_scheduler.draw_gui();
+        scene.sun.shadow_map->apply_scheduled_cascades();
+    }
 
-    // Shadows
-    if (BAKE_SHADOWMAPS == false || !did_bake_shadows)
+    // Upload everything shared between passes in one go
+    FrameUniforms frame;
+    frame.view = view;
+    frame.projection = projection;
+    frame.view_projection = projection * view;
+    frame.inverse_view_projection = glm::inverse(frame.view_projection);
+    frame.previous_view_projection = previous_view_projection.value_or(frame.view_projection);
+    previous_view_projection = frame.view_projection;
+    for (unsigned int i = 0; i < max_shadow_cascades; ++i)
     {
-        shadow_pass.render(scene, light_projection);
-        did_bake_shadows = true;
+        frame.lightspace[i] = scene.sun.shadow_map->matrices[i];
+        frame.cascade_splits[i] = scene.sun.shadow_map->splits[i];
     }
+    frame.shadow_settings = glm::vec4(
+        scene.sun.shadow_map->cascades,
+        (float)scene.sun.shadow_map->filter,
+        0.0f,
+        0.0f
+    );
+    frame.camera_position = glm::vec4(scene.camera.position, 1.0f);
+    frame.sun_position = glm::vec4(scene.sun.position, 1.0f);
+    frame.sun_colour = glm::vec4(scene.sun.colour, 1.0f);
+    frame.cloud_shadow_area = cloud_pass.get_shadow_area();
+    frame.screen = glm::vec4(render_width(), render_height(), z_near, z_far);
+    frame_uniform_buffer.update(&frame);
+
+    // Enable culling, etc.
+    gl_state::set_enabled(GL_DEPTH_TEST, true);
+    gl_state::set_enabled(GL_CULL_FACE, true);
+
+    // Shadows
+    gpu_profiler.begin("Shadows");
+    shadow_pass.render(scene, frame);
+    gpu_profiler.end();
 
     // Fill G-buffer
-    g_buffer_pass.render(scene, view, projection);
+    gpu_profiler.begin("G-buffer");
+    g_buffer_pass.render(scene, frame);
+    gpu_profiler.end();
 
     // Culling, etc. no longer needed (but quads from hereon)
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_CULL_FACE);
+    gl_state::set_enabled(GL_DEPTH_TEST, false);
+    gl_state::set_enabled(GL_CULL_FACE, false);
     quad_mesh->bind();
 
     // Ambient occlusion
+    gpu_profiler.begin("SSAO");
     ao_pass.render(
-        *g_buffer_pass.g_buffer.position_texture,
         *g_buffer_pass.g_buffer.normal_texture,
-        *g_buffer_pass.g_buffer.depth_map,
-        view,
-        projection
+        *g_buffer_pass.g_buffer.depth_map
     );
+    gpu_profiler.end();
+
+    // Cloud shadows
+    gpu_profiler.begin("Cloud shadows");
+    cloud_pass.render_shadows(scene);
+    gpu_profiler.end();
 
     // Lighting
+    gpu_profiler.begin("Lighting");
     lighting_pass.render(
         scene,
-        light_projection,
-        cloud_pass.noises[0],
-        *scene.sun.shadow_buffer->depth_map,
+        cloud_pass.get_shadows(),
+        *scene.sun.shadow_map,
         *ao_pass.output_framebuffer.colour_texture,
         g_buffer_pass.g_buffer
     );
+    gpu_profiler.end();
 
     // Skybox
-    sky_pass.render(scene, view, projection, g_buffer_pass.g_buffer);
+    gpu_profiler.begin("Sky");
+    sky_pass.render(scene, g_buffer_pass.g_buffer);
+    gpu_profiler.end();
 
     // All future state only renders quads
     quad_mesh->bind();
 
-    /*water_pass.render(
+    // Water (reflecting and refracting what's been drawn so far)
+    gpu_profiler.begin("Water");
+    water_pass.render(
         scene,
-        view,
-        projection,
-        light_projection,
-        cloud_pass.noises[0],
-        output_framebuffer,
-        diffuse_pass
-    );*/
+        g_buffer_pass.g_buffer,
+        cloud_pass.get_shadows(),
+        lighting_pass.output_framebuffer
+    );
+    gpu_profiler.end();
 
     // Clouds (whose framebuffer may now become the main output)
     if (scene.cloud_settings.enabled)
     {
-        cloud_pass.render(
-            scene,
-            view,
-            projection,
-            *g_buffer_pass.g_buffer.depth_map
-        );
+        gpu_profiler.begin("Clouds");
+        cloud_pass.render(scene, *g_buffer_pass.g_buffer.depth_map);
+        gpu_profiler.end();
     }
+    else cloud_pass.invalidate_history();
 
     Texture& output = *lighting_pass.output_framebuffer.colour_texture;
 
     // Post processing
+    gpu_profiler.begin("Bloom");
     bloom_pass.render(output);
+    gpu_profiler.end();
 
     // Display scaled output...
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(0, 0, window.framebuffer_width, window.framebuffer_height);
+    gl_state::bind_framebuffer(window.output_framebuffer);
+    gl_state::viewport(0, 0, window.framebuffer_width, window.framebuffer_height);
     glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 
     // ...combining FBOs (with HDR pass)
+    gpu_profiler.begin("Composite");
     if (scene.cloud_settings.enabled)
     {
         composite_pass.render(
             output,
             *bloom_pass.get_output().colour_texture,
-            *cloud_pass.output_framebuffer.colour_texture
+            *cloud_pass.get_output().colour_texture
         );
     }
     else
@@ -140,29 +209,115 @@ bool Renderer::update(Scene& scene)
             output
         );
     }
+    gpu_profiler.end();
 
     // Sprites
+    gpu_profiler.begin("Sprites");
     sprite_pass.render(scene, projection);
+    gpu_profiler.end();
+
+    // Upload (or evict) texture mips based on what this frame asked for
+    draw_texture_stats_gui();
+    gpu_profiler.begin("Texture streaming");
+    stream_textures(
+        (size_t)texture_budget_mb * 1024 * 1024,
+        (size_t)TEXTURE_UPLOAD_BUDGET_KB * 1024
+    );
+    gpu_profiler.end();
+
+    // Unreferenced resources stay cached for a while in case they're wanted
+    // again, then get purged (the debug button does it straight away)
+    if (++frames_since_purge >= RESOURCE_PURGE_INTERVAL)
+    {
+        purge_unused_resources();
+        frames_since_purge = 0;
+    }
+
+    // Destroy anything purged during the last frame
+    collect_resources();
+
+#if DEBUG
+    // Redundant state changes caught this frame
+    const auto gl_stats = gl_state::get_stats();
+    ImGui::Begin("GL state");
+    ImGui::Text("Issued: %u", gl_stats.issued);
+    ImGui::Text("Skipped: %u", gl_stats.skipped);
+    ImGui::End();
+    gl_state::reset_stats();
+#endif
 
     // ImGui
-    ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    gpu_profiler.draw_gui();
+    cpu_profiler::draw_gui();
+    if (window.headless)
+    {
+        // Live timings would make every frame differ - headless output is
+        // just the scene, so screenshots are repeatable
+        ImGui::EndFrame();
+    }
+    else
+    {
+        gpu_profiler.begin("ImGui");
+        PROFILE_ZONE("ImGui::Render");
+        ImGui::Render();
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        gpu_profiler.end();
+    }
+    gpu_profiler.end_frame();
 
-    glViewport(0, 0, render_width(), render_height());
+    // ImGui doesn't go through the state cache
+    gl_state::invalidate();
+    gl_state::viewport(0, 0, render_width(), render_height());
 
     // Calculate FPS
-    double end = glfwGetTime();
+    double end = window.get_time();
     int fps = int(1.0 / (end - start));
 
-    if (glfwGetTime() - last_fps_report_time >= 1.0)
+    if (end - last_fps_report_time >= 1.0)
     {
         std::cout << fps << " fps - " << (end-start) * 1000 << " ms" << std::endl;
-        last_fps_report_time = glfwGetTime();
+        last_fps_report_time = end;
     }
 
     return true;
 }
 
+void Renderer::draw_texture_stats_gui()
+{
+    const auto stats = get_texture_stats();
+    size_t resident = 0;
+    size_t total = 0;
+    for (const auto& texture : stats)
+    {
+        resident += texture.resident_size;
+        total += texture.total_size;
+    }
+
+    ImGui::Begin("Textures");
+    ImGui::SliderInt("Budget (MB)", &texture_budget_mb, 16, 4096);
+    ImGui::Text("Resident: %.1f / %.1f MB", resident / (1024.0f * 1024.0f), total / (1024.0f * 1024.0f));
+    if (ImGui::Button("Purge unused resources")) purge_unused_resources();
+    if (ImGui::BeginTable("textures", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+    {
+        ImGui::TableSetupColumn("Texture");
+        ImGui::TableSetupColumn("Resident (KB)");
+        ImGui::TableSetupColumn("Mip (resident / wanted)");
+        ImGui::TableHeadersRow();
+        for (const auto& texture : stats)
+        {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(texture.filename.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%zu", texture.resident_size / 1024);
+            ImGui::TableNextColumn();
+            ImGui::Text("%u / %u", texture.resident_mip, texture.requested_mip);
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
+
 unsigned int Renderer::render_width() const
 {
     return window.framebuffer_width * render_scale;
@@ -1,31 +1,46 @@
 #include "resources.h"
+#include "cpu_profiler.h"
+#include "config.h"
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 #include <unordered_map>
 #include <functional>
 #include <iostream>
+#include <algorithm>
 
-// We use T*'s so that:
-// a) we can return persistent pointers
-// b) copy constructor woes are avoided
-static std::unordered_map<std::string, Mesh*> meshes;
-static std::unordered_map<std::string, Texture*> textures;
+// Resources live in pools and are handed out as reference-counted handles,
+// with the names they were loaded under mapping to their handles
+static ResourcePool<Mesh>* meshes = nullptr;
+static ResourcePool<Texture>* textures = nullptr;
+static std::unordered_map<std::string, Handle<Mesh>> mesh_names;
+static std::unordered_map<std::string, Handle<Texture>> texture_names;
 
-static Mesh* mesh_from_assimp(const aiMesh* assimp_mesh, const std::string& id);
+static MeshRef mesh_from_assimp(const aiMesh* assimp_mesh, const std::string& id);
 static Material material_from_assimp(const aiMaterial* material, const std::string& path);
 
 Mesh* quad_mesh;
 Mesh* cube_mesh;
+InstanceBuffer* instance_buffer = nullptr;
+
+// Incremented by collect_resources() so we know what was used least recently,
+// and when purged resources are safe to destroy
+static unsigned long long frame = 0;
 
 void init_resources()
 {
+    // Before any meshes, which need it for their VAOs
+    instance_buffer = new InstanceBuffer(MAX_INSTANCES);
+
     quad_mesh = Mesh::quad();
     cube_mesh = Mesh::cube();
+    meshes = new ResourcePool<Mesh>();
+    textures = new ResourcePool<Texture>();
 }
 
 std::vector<TexturedMesh> load_assimp_scene(const std::string& filename)
 {
+    PROFILE_ZONE("load_assimp_scene");
     Assimp::Importer importer;
     std::vector<TexturedMesh> textured_meshes;
 
@@ -65,10 +80,12 @@ std::vector<TexturedMesh> load_assimp_scene(const std::string& filename)
     return textured_meshes;
 }
 
-static Mesh* mesh_from_assimp(const aiMesh* assimp_mesh, const std::string& id)
+static MeshRef mesh_from_assimp(const aiMesh* assimp_mesh, const std::string& id)
 {
-    // Use cached version if available
-    if (meshes.contains(id)) return meshes[id];
+    PROFILE_ZONE("mesh_from_assimp");
+    // Use cached version if available (and not yet purged)
+    if (mesh_names.contains(id) && meshes->is_valid(mesh_names[id]))
+        return MeshRef(&meshes, mesh_names[id]);
 
     std::vector<float>          vertices;
     std::vector<float>          normals;
@@ -115,13 +132,14 @@ static Mesh* mesh_from_assimp(const aiMesh* assimp_mesh, const std::string& id)
     }
 
     // Cache for later then return
-    Mesh* mesh = new Mesh(vertices, indices, texture_coords, normals, tangents);
-    meshes.emplace(id, mesh);
-    return mesh;
+    const Handle<Mesh> handle = meshes->insert(new Mesh(vertices, indices, texture_coords, normals, tangents));
+    mesh_names[id] = handle;
+    return MeshRef(&meshes, handle);
 }
 
 static Material material_from_assimp(const aiMaterial* material, const std::string& path)
 {
+    PROFILE_ZONE("material_from_assimp");
     // Remove filename from path (so we're just left with directory)
     const std::string directory = path.substr(0, path.find_last_of('/')) + std::string("/");
 
@@ -144,9 +162,9 @@ static Material material_from_assimp(const aiMaterial* material, const std::stri
     const auto normal_map = [&]()
     {
         if (material->GetTextureCount(aiTextureType_NORMALS))
-            return std::optional<Texture*>(from_assimp(aiTextureType_NORMALS));
+            return std::optional<TextureRef>(from_assimp(aiTextureType_NORMALS));
         else
-            return std::optional<Texture*>();
+            return std::optional<TextureRef>();
     };
 
     return Material {
@@ -155,17 +173,153 @@ static Material material_from_assimp(const aiMaterial* material, const std::stri
     };
 }
 
-Texture* get_texture(const std::string& filename, const bool use_nearest_filtering)
+TextureRef get_texture(const std::string& filename, const bool use_nearest_filtering)
+{
+    PROFILE_ZONE("get_texture");
+    if (texture_names.contains(filename) && textures->is_valid(texture_names[filename]))
+        return TextureRef(&textures, texture_names[filename]);
+
+    // Pixel-art textures (sprites, atlases) are tiny and pick their own mip range
+    const bool use_streaming = TEXTURE_STREAMING && !use_nearest_filtering;
+    const Handle<Texture> handle = textures->insert(new Texture(filename, use_nearest_filtering, use_streaming));
+    texture_names[filename] = handle;
+    return TextureRef(&textures, handle);
+}
+
+size_t purge_unused_resources()
+{
+    const size_t purged = meshes->purge_unused(frame) + textures->purge_unused(frame);
+
+    // Forget the names of anything that was purged so it gets reloaded if asked for again
+    std::erase_if(mesh_names, [](const auto& pair) { return !meshes->is_valid(pair.second); });
+    std::erase_if(texture_names, [](const auto& pair) { return !textures->is_valid(pair.second); });
+    return purged;
+}
+
+void collect_resources()
+{
+    meshes->collect(frame);
+    textures->collect(frame);
+    ++frame;
+}
+
+void stream_textures(const size_t budget, const size_t upload_budget)
+{
+    PROFILE_ZONE("stream_textures");
+    std::vector<Texture*> streamed;
+    size_t resident = 0;
+    textures->for_each([&](const Handle<Texture>, Texture* texture)
+    {
+        if (!texture->is_streamed()) return;
+
+        if (texture->used_this_frame) texture->last_used_frame = frame;
+        resident += texture->resident_size();
+        streamed.push_back(texture);
+    });
+
+    // Mips finer than what was asked for go first, then least recently used.
+    // Making room for an upload never costs a texture used this frame (least
+    // of all the one being uploaded) - it'd only be streamed straight back in
+    const auto evict_one = [&](const Texture* streaming)
+    {
+        const auto priority = [](const Texture* texture)
+        {
+            const bool unneeded = texture->resident_mip < texture->requested_mip;
+            return std::make_pair(!unneeded, texture->last_used_frame);
+        };
+
+        Texture* victim = nullptr;
+        for (Texture* texture : streamed)
+        {
+            if (texture->resident_mip >= texture->base_resident_mip) continue;
+            if (streaming && (texture == streaming || texture->last_used_frame >= frame)) continue;
+            if (!victim || priority(texture) < priority(victim)) victim = texture;
+        }
+
+        return victim ? victim->evict() : (size_t)0;
+    };
+
+    // Stream in the textures missing the most detail first
+    std::vector<Texture*> wanted;
+    for (Texture* texture : streamed)
+        if (texture->used_this_frame && texture->requested_mip < texture->resident_mip)
+            wanted.push_back(texture);
+
+    std::sort(wanted.begin(), wanted.end(), [](const Texture* a, const Texture* b)
+    {
+        return a->resident_mip - a->requested_mip > b->resident_mip - b->requested_mip;
+    });
+
+    size_t uploaded = 0;
+    for (Texture* texture : wanted)
+    {
+        while (texture->requested_mip < texture->resident_mip)
+        {
+            const size_t size = texture->next_mip_size();
+            if (uploaded + size > upload_budget) break;
+
+            // Make room, but never by evicting something that was used this frame
+            bool has_room = true;
+            while (resident + size > budget && has_room)
+            {
+                const size_t freed = evict_one(texture);
+                resident -= freed;
+                has_room = freed > 0;
+            }
+            if (!has_room) break;
+
+            resident += texture->stream_in();
+            uploaded += size;
+        }
+    }
+
+    // Budget may have shrunk since last frame - anything goes
+    while (resident > budget)
+    {
+        const size_t freed = evict_one(nullptr);
+        if (freed == 0) break;
+        resident -= freed;
+    }
+
+    for (Texture* texture : streamed)
+        texture->used_this_frame = false;
+}
+
+std::vector<TextureStats> get_texture_stats()
 {
-    if (textures.contains(filename)) return textures[filename];
-    auto iterator = textures.emplace(filename, new Texture(filename, use_nearest_filtering)).first;
-    return iterator->second;
+    std::vector<TextureStats> stats;
+    for (const auto& [filename, handle] : texture_names)
+    {
+        const Texture* texture = textures->get(handle);
+        if (!texture || !texture->is_streamed()) continue;
+        stats.push_back({
+            .filename = filename,
+            .resident_size = texture->resident_size(),
+            .total_size = texture->total_size(),
+            .resident_mip = texture->resident_mip,
+            .requested_mip = texture->requested_mip,
+            .mip_count = texture->mip_count()
+        });
+    }
+
+    std::sort(stats.begin(), stats.end(), [](const TextureStats& a, const TextureStats& b)
+    {
+        return a.resident_size > b.resident_size;
+    });
+    return stats;
 }
 
 void free_resources()
 {
-    for(auto& mesh : meshes) delete mesh.second;
-    for(auto& texture : textures) delete texture.second;
+    // Any refs still alive after this simply resolve to nullptr
+    delete meshes;
+    delete textures;
+    meshes = nullptr;
+    textures = nullptr;
+    mesh_names.clear();
+    texture_names.clear();
     delete quad_mesh;
     delete cube_mesh;
+    delete instance_buffer;
+    instance_buffer = nullptr;
 }
@@ -1,9 +1,14 @@
 #include "shader.h"
+#include "cpu_profiler.h"
+#include "config.h"
+#include "gl_state.h"
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <stdexcept>
+#include <filesystem>
+#include <chrono>
 #include <glad/glad.h>
 
 std::array<Shader::ShaderType, 3> Shader::shader_types =
@@ -13,8 +18,13 @@ std::array<Shader::ShaderType, 3> Shader::shader_types =
     { .extension = ".comp", .identifier = GL_COMPUTE_SHADER  }
 }};
 
+double Shader::total_load_time = 0.0;
+unsigned int Shader::cache_hits = 0;
+unsigned int Shader::cache_misses = 0;
+
 Shader::Shader(const std::string& filename, const std::vector<ShaderTypeID>& shader_type_ids)
 {
+    PROFILE_ZONE("Shader::Shader");
     const auto read_file = [](const std::string path)
     {
         std::ifstream in("../res/shaders/" + path);
@@ -23,6 +33,27 @@ Shader::Shader(const std::string& filename, const std::vector<ShaderTypeID>& sha
         return contents;
     };
 
+    // Expand #include "file" lines (used for uniform blocks shared between shaders)
+    const auto preprocess = [&](const std::string& source)
+    {
+        std::stringstream in(source);
+        std::string result;
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (line.starts_with("#include"))
+            {
+                const size_t first = line.find('"');
+                const size_t last = line.find_last_of('"');
+                if (first == std::string::npos || first == last)
+                    throw std::runtime_error("malformed include in shader " + filename);
+                result += read_file(line.substr(first + 1, last - first - 1)) + "\n";
+            }
+            else result += line + "\n";
+        }
+        return result;
+    };
+
     struct ShaderTarget
     {
         std::string source;
@@ -30,17 +61,40 @@ Shader::Shader(const std::string& filename, const std::vector<ShaderTypeID>& sha
         ShaderTypeID type_id;
     };
 
+    const auto start = std::chrono::steady_clock::now();
+
     // Load from disk
     std::vector<ShaderTarget> targets;
     for (const ShaderTypeID id : shader_type_ids)
     {
         targets.emplace_back(ShaderTarget {
-            .source = read_file(filename + shader_types[id].extension),
+            .source = preprocess(read_file(filename + shader_types[id].extension)),
             .shader = 0,
             .type_id = id
         });
     }
 
+    // Use a previously linked binary if the driver still accepts it...
+    std::string cache_path;
+    if (SHADER_CACHE)
+    {
+        std::string key;
+        for (const auto& target : targets)
+            key += shader_types[target.type_id].extension + target.source;
+        cache_path = get_cache_path(filename, key);
+
+        if (load_binary(cache_path))
+        {
+            enumerate_uniforms();
+            ++cache_hits;
+            total_load_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return;
+        }
+        ++cache_misses;
+    }
+
+    // ...otherwise compile from source
+
     // Upload source code
     for (auto& target : targets)
     {
@@ -68,22 +122,98 @@ Shader::Shader(const std::string& filename, const std::vector<ShaderTypeID>& sha
     program = glCreateProgram();
     for (auto& target : targets)
         glAttachShader(program, target.shader);
+    if (SHADER_CACHE) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program);
     handle_error(glGetProgramiv, glGetProgramInfoLog, program, GL_LINK_STATUS, "shader failed to link", filename);
 
     // Shaders themselves no longer needed - all we need is the final program
     for (auto& target : targets)
         glDeleteShader(target.shader);
+
+    if (SHADER_CACHE) save_binary(cache_path);
+    enumerate_uniforms();
+    total_load_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string Shader::get_cache_path(const std::string& filename, const std::string& source)
+{
+    // FNV-1a over the source and whatever identifies the driver (binaries
+    // aren't portable between drivers, or even driver versions)
+    uint64_t hash = 14695981039346656037ull;
+    const auto add = [&](const std::string& data)
+    {
+        for (const char c : data)
+        {
+            hash ^= (unsigned char)c;
+            hash *= 1099511628211ull;
+        }
+    };
+
+    for (const auto name : { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION })
+        add((const char*)glGetString(name));
+    add(source);
+
+    std::stringstream path;
+    path << SHADER_CACHE_DIRECTORY << filename << "-" << std::hex << hash << ".bin";
+    return path.str();
+}
+
+bool Shader::load_binary(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+
+    // Format enum followed by the binary itself
+    GLenum format;
+    if (!in.read((char*)&format, sizeof(format))) return false;
+    std::vector<char> binary((std::istreambuf_iterator<char>)(in), std::istreambuf_iterator<char>());
+    if (binary.empty()) return false;
+
+    // Drivers are free to reject binaries (e.g. after an update)
+    program = glCreateProgram();
+    glProgramBinary(program, format, binary.data(), binary.size());
+
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glDeleteProgram(program);
+        return false;
+    }
+    return true;
+}
+
+void Shader::save_binary(const std::string& path) const
+{
+    int length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    GLenum format;
+    std::vector<char> binary(length);
+    glGetProgramBinary(program, length, NULL, &format, binary.data());
+
+    std::error_code error;
+    std::filesystem::create_directories(SHADER_CACHE_DIRECTORY, error);
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+    {
+        std::cerr << "unable to write shader cache " << path << std::endl;
+        return;
+    }
+
+    out.write((const char*)&format, sizeof(format));
+    out.write(binary.data(), binary.size());
 }
 
 void Shader::bind() const
 {
-    glUseProgram(program);
+    gl_state::use_program(program);
 }
 
 void Shader::unbind() const
 {
-    glUseProgram(0);
+    gl_state::use_program(0);
 }
 
 SHADER_UNIFORM(const glm::mat4& matrix) { glUniformMatrix4fv(NAME, 1, GL_FALSE, glm::value_ptr(matrix)); }
@@ -93,6 +223,13 @@ SHADER_UNIFORM(const glm::vec2& vector) { glUniform2f(NAME, vector.x, vector.y);
 SHADER_UNIFORM(const float value)       { glUniform1f(NAME, value); }
 SHADER_UNIFORM(const int value)         { glUniform1i(NAME, value); }
 
+SHADER_UNIFORM_HANDLE(glm::mat4, const glm::mat4& matrix) { glUniformMatrix4fv(LOCATION, 1, GL_FALSE, glm::value_ptr(matrix)); }
+SHADER_UNIFORM_HANDLE(glm::vec4, const glm::vec4& vector) { glUniform4f(LOCATION, vector.x, vector.y, vector.z, vector.w); }
+SHADER_UNIFORM_HANDLE(glm::vec3, const glm::vec3& vector) { glUniform3f(LOCATION, vector.x, vector.y, vector.z); }
+SHADER_UNIFORM_HANDLE(glm::vec2, const glm::vec2& vector) { glUniform2f(LOCATION, vector.x, vector.y); }
+SHADER_UNIFORM_HANDLE(float, const float value)           { glUniform1f(LOCATION, value); }
+SHADER_UNIFORM_HANDLE(int, const int value)               { glUniform1i(LOCATION, value); }
+
 void Shader::handle_error(auto f, auto f2, const unsigned int id,
         const unsigned int type, const std::string& error, const std::string& filename)
 {
@@ -108,18 +245,61 @@ void Shader::handle_error(auto f, auto f2, const unsigned int id,
 
 int Shader::get_uniform_location(const std::string& name)
 {
-    // Use cached version...
+    PROFILE_ZONE("Shader::get_uniform_location");
+    // All active uniforms are known after linking...
     if (uniforms.contains(name))
         return uniforms.at(name);
 
-    // ...or get from OpenGL then store for later
-    int result = glGetUniformLocation(program, name.c_str());
-    if (result < 0) std::cout << "failed to create uniform "  << name << std::endl;
-    uniforms.emplace(name, result);
-    return result;
+    // ...so anything else was optimised out (or misspelt) - only warn once
+    std::cout << "failed to create uniform "  << name << std::endl;
+    uniforms.emplace(name, -1);
+    return -1;
+}
+
+void Shader::enumerate_uniforms()
+{
+    int count = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+
+    for (int i = 0; i < count; ++i)
+    {
+        char name[256];
+        int length, size;
+        GLenum type;
+        glGetActiveUniform(program, i, sizeof(name), &length, &size, &type, name);
+
+        // Members of uniform blocks have no location
+        const int location = glGetUniformLocation(program, name);
+        if (location < 0) continue;
+
+        // Arrays are reported as "name[0]"; store every element
+        std::string uniform_name(name, length);
+        if (uniform_name.ends_with("[0]"))
+        {
+            const std::string base = uniform_name.substr(0, uniform_name.size() - 3);
+            uniforms[base] = location;
+            for (int j = 0; j < size; ++j)
+            {
+                const std::string element = base + "[" + std::to_string(j) + "]";
+                uniforms[element] = glGetUniformLocation(program, element.c_str());
+            }
+        }
+        else uniforms[uniform_name] = location;
+    }
+
+    // Hook up any shared uniform blocks to their binding points
+    const std::pair<const char*, UniformBlockBinding> blocks[] = {
+        { "Frame", UniformBlockBinding::FrameBlock }
+    };
+    for (const auto& [block, binding] : blocks)
+    {
+        const unsigned int index = glGetUniformBlockIndex(program, block);
+        if (index != GL_INVALID_INDEX) glUniformBlockBinding(program, index, binding);
+    }
 }
 
 Shader::~Shader()
 {
+    gl_state::forget_program(program);
     glDeleteProgram(program);
 }
\ No newline at end of file
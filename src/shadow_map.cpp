@@ -0,0 +1,284 @@
+#include "shadow_map.h"
+#include "cpu_profiler.h"
+#include "gl_state.h"
+#include <glad/glad.h>
+#include <stdexcept>
+#include <string>
+#include <cmath>
+
+ShadowMap::ShadowMap(const unsigned int resolution, const unsigned int cascades) :
+    resolution(resolution), cascades(cascades),
+    moments_resolution(std::max(resolution / 2, 1u)),
+    moments_scratch(moments_resolution, moments_resolution)
+{
+    if (cascades == 0 || cascades > max_shadow_cascades)
+        throw std::runtime_error("unsupported number of shadow cascades " + std::to_string(cascades));
+
+    create_layers(texture, framebuffers);
+    create_layers(static_texture, static_framebuffers);
+    create_moments();
+    moments_scratch.colour_texture->clamp(glm::vec4(0.0f), false);
+    invalidate_static();
+
+    // Nearer cascades are smaller, so fall behind the camera sooner
+    for (unsigned int i = 0; i < cascades; ++i)
+        views.push_back(std::make_unique<OffscreenView>("Shadow cascade " + std::to_string(i), float(1u << (cascades - i - 1))));
+
+    // Same texture, but sampled with hardware depth comparisons (and bilinear
+    // filtering of their results) for PCF
+    glGenSamplers(1, &compare_sampler);
+    glSamplerParameteri(compare_sampler, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glSamplerParameteri(compare_sampler, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glSamplerParameteri(compare_sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glSamplerParameteri(compare_sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(compare_sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glSamplerParameteri(compare_sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    const float border_colour[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glSamplerParameterfv(compare_sampler, GL_TEXTURE_BORDER_COLOR, border_colour);
+}
+
+void ShadowMap::create_layers(unsigned int& array, std::vector<unsigned int>& layer_framebuffers)
+{
+    // Depth texture array using *nearest* filtering, with anything outside of it unshadowed
+    const float border_colour[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glGenTextures(1, &array);
+    gl_state::bind_texture(0, GL_TEXTURE_2D_ARRAY, array);
+    glTexImage3D(
+        GL_TEXTURE_2D_ARRAY,
+        0,
+        GL_DEPTH_COMPONENT32F,
+        resolution,
+        resolution,
+        cascades,
+        0,
+        GL_DEPTH_COMPONENT,
+        GL_FLOAT,
+        NULL
+    );
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border_colour);
+
+    // One depth-only framebuffer per layer
+    layer_framebuffers.resize(cascades);
+    glGenFramebuffers(cascades, layer_framebuffers.data());
+    for (unsigned int i = 0; i < cascades; ++i)
+    {
+        gl_state::bind_framebuffer(layer_framebuffers[i]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, array, 0, i);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            throw std::runtime_error("incomplete shadow map framebuffer - " +
+                std::to_string(glCheckFramebufferStatus(GL_FRAMEBUFFER)));
+    }
+    gl_state::bind_framebuffer(0);
+}
+
+void ShadowMap::create_moments()
+{
+    // Border is the moments of the far plane (must match evsm.frag), so again unshadowed
+    const float positive = std::exp(5.0f);
+    const float negative = -std::exp(-5.0f);
+    const float border_colour[] = { positive, positive * positive, negative, negative * negative };
+
+    glGenTextures(1, &moments_texture);
+    gl_state::bind_texture(0, GL_TEXTURE_2D_ARRAY, moments_texture);
+    glTexImage3D(
+        GL_TEXTURE_2D_ARRAY,
+        0,
+        GL_RGBA16F,
+        moments_resolution,
+        moments_resolution,
+        cascades,
+        0,
+        GL_RGBA,
+        GL_FLOAT,
+        NULL
+    );
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border_colour);
+
+    moments_framebuffers.resize(cascades);
+    glGenFramebuffers(cascades, moments_framebuffers.data());
+    for (unsigned int i = 0; i < cascades; ++i)
+    {
+        gl_state::bind_framebuffer(moments_framebuffers[i]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, moments_texture, 0, i);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            throw std::runtime_error("incomplete shadow moments framebuffer - " +
+                std::to_string(glCheckFramebufferStatus(GL_FRAMEBUFFER)));
+    }
+    gl_state::bind_framebuffer(0);
+
+    moments_dirty.fill(true);
+}
+
+void ShadowMap::update_cascades(
+    const Camera& camera,
+    const glm::vec3& light_direction,
+    const float width,
+    const float height,
+    ViewScheduler& scheduler
+)
+{
+    PROFILE_ZONE("ShadowMap::update_cascades");
+    // "Practical" split scheme - a blend of logarithmic and uniform splits
+    const float near = z_near;
+    const float far = std::min(distance, z_far);
+    std::array<float, max_shadow_cascades> new_splits = {};
+    for (unsigned int i = 0; i < cascades; ++i)
+    {
+        const float fraction = float(i + 1) / float(cascades);
+        const float logarithmic = near * std::pow(far / near, fraction);
+        const float uniform = near + (far - near) * fraction;
+        new_splits[i] = split_lambda * logarithmic + (1.0f - split_lambda) * uniform;
+    }
+
+    // The splits changing invalidates every cascade at once
+    const bool refit_all = !caching || new_splits != splits;
+    splits = new_splits;
+    fitted_light_direction = glm::normalize(light_direction);
+
+    float previous_split = near;
+    for (unsigned int i = 0; i < cascades; ++i)
+    {
+        fits[i] = fit_cascade(camera, light_direction, width, height, previous_split, splits[i]);
+        previous_split = splits[i];
+
+        // Small moves of the camera or light can wait their turn, but not ones
+        // that'd leave much of the slice outside of the cascade
+        const bool camera_moved = glm::distance(fits[i].centre, centres[i]) > fits[i].radius * SHADOW_URGENT_MOVE;
+        const bool light_moved = glm::dot(fitted_light_direction, light_directions[i]) < std::cos(glm::radians(SHADOW_URGENT_ANGLE));
+        scheduler.submit(*views[i], fits[i].matrix != matrices[i], refit_all || camera_moved || light_moved);
+    }
+}
+
+void ShadowMap::apply_scheduled_cascades()
+{
+    for (unsigned int i = 0; i < cascades; ++i)
+    {
+        if (!views[i]->is_scheduled() || fits[i].matrix == matrices[i]) continue;
+        matrices[i] = fits[i].matrix;
+        centres[i] = fits[i].centre;
+        light_directions[i] = fitted_light_direction;
+        static_dirty[i] = true;
+    }
+}
+
+ShadowMap::Fit ShadowMap::fit_cascade(
+    const Camera& camera,
+    const glm::vec3& light_direction,
+    const float width,
+    const float height,
+    const float near,
+    const float far
+) const
+{
+    const auto corners = camera.get_frustum_corners_in_world_space(width, height, near, far);
+
+    // Bound the slice with a sphere, so that the projection keeps the same size
+    // however the camera rotates (rounded up to stop it flickering)
+    glm::vec3 centre = {};
+    for (const auto& corner : corners)
+        centre += glm::vec3(corner);
+    centre /= float(corners.size());
+
+    float radius = 0.0f;
+    for (const auto& corner : corners)
+        radius = std::max(radius, glm::length(glm::vec3(corner) - centre));
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+
+    // Casters in front of the near plane are handled by depth clamping
+    const glm::vec3 direction = glm::normalize(light_direction);
+    const glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    const glm::mat4 view = glm::lookAt(centre + direction * radius, centre, up);
+    glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius);
+
+    // Snap to whole texels so that edges don't crawl as the camera moves
+    const glm::vec4 origin = projection * view * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f) * (resolution * 0.5f);
+    const glm::vec4 offset = (glm::round(origin) - origin) * (2.0f / resolution);
+    projection[3][0] += offset.x;
+    projection[3][1] += offset.y;
+
+    return { projection * view, centre, radius };
+}
+
+void ShadowMap::bind_layer(const unsigned int cascade) const
+{
+    gl_state::bind_framebuffer(framebuffers[cascade]);
+    gl_state::viewport(0, 0, resolution, resolution);
+}
+
+void ShadowMap::bind_static_layer(const unsigned int cascade) const
+{
+    gl_state::bind_framebuffer(static_framebuffers[cascade]);
+    gl_state::viewport(0, 0, resolution, resolution);
+}
+
+void ShadowMap::bind_moments_layer(const unsigned int cascade) const
+{
+    gl_state::bind_framebuffer(moments_framebuffers[cascade]);
+    gl_state::viewport(0, 0, moments_resolution, moments_resolution);
+}
+
+void ShadowMap::restore_static_layer(const unsigned int cascade) const
+{
+    glCopyImageSubData(
+        static_texture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, cascade,
+        texture,        GL_TEXTURE_2D_ARRAY, 0, 0, 0, cascade,
+        resolution, resolution, 1
+    );
+}
+
+void ShadowMap::invalidate_static()
+{
+    static_dirty.fill(true);
+}
+
+void ShadowMap::bind(const unsigned int unit) const
+{
+    gl_state::bind_texture(unit, GL_TEXTURE_2D_ARRAY, texture);
+}
+
+void ShadowMap::bind_compare(const unsigned int unit) const
+{
+    gl_state::bind_texture(unit, GL_TEXTURE_2D_ARRAY, texture);
+    glBindSampler(unit, compare_sampler);
+}
+
+// Samplers override the texture's own state, so the unit must be handed back
+void ShadowMap::unbind_compare(const unsigned int unit) const
+{
+    glBindSampler(unit, 0);
+}
+
+void ShadowMap::bind_moments(const unsigned int unit) const
+{
+    gl_state::bind_texture(unit, GL_TEXTURE_2D_ARRAY, moments_texture);
+}
+
+ShadowMap::~ShadowMap()
+{
+    for (const auto& layers : { framebuffers, static_framebuffers, moments_framebuffers })
+    {
+        for (const auto framebuffer : layers)
+            gl_state::forget_framebuffer(framebuffer);
+        glDeleteFramebuffers(layers.size(), layers.data());
+    }
+
+    for (const auto array : { texture, static_texture, moments_texture })
+    {
+        gl_state::forget_texture(array);
+        glDeleteTextures(1, &array);
+    }
+
+    glDeleteSamplers(1, &compare_sampler);
+}
@@ -1,9 +1,13 @@
 #include "texture.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
+#include "config.h"
+#include "gl_state.h"
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 
-Texture::Texture(const std::string& filename, const bool use_nearest_filtering)
+Texture::Texture(const std::string& filename, const bool use_nearest_filtering, const bool use_streaming)
 {
     // Load from disk
     int width, height, channels;
@@ -12,15 +16,78 @@ Texture::Texture(const std::string& filename, const bool use_nearest_filtering)
 
     // Create and bind texture
     glGenTextures(1, &texture_id);
-    glBindTexture(texture_type, texture_id);
+    gl_state::bind_texture(0, texture_type, texture_id);
 
     // Upload data
-    const auto format = (channels == 3 ? GL_RGB : GL_RGBA);
-    const auto formatInternal = (channels == 3 ? GL_RGB8 : GL_RGBA8);
-    glTexImage2D(texture_type, 0, formatInternal, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+    format = (channels == 3 ? GL_RGB : GL_RGBA);
+    internal_format = (channels == 3 ? GL_RGB8 : GL_RGBA8);
+
+    if (!use_streaming)
+    {
+        glTexImage2D(texture_type, 0, internal_format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glGenerateMipmap(texture_type);
+    }
+    else
+    {
+        // Build the whole mip chain on the CPU with a 2x2 box filter
+        const unsigned int pixel_size = (channels == 3 ? 3 : 4);
+        mips.push_back({
+            (unsigned int)width,
+            (unsigned int)height,
+            std::vector<unsigned char>(data, data + width * height * pixel_size)
+        });
+
+        while (mips.back().width > 1 || mips.back().height > 1)
+        {
+            const MipLevel& previous = mips.back();
+            MipLevel mip = {
+                std::max(previous.width / 2, 1u),
+                std::max(previous.height / 2, 1u),
+                {}
+            };
+            mip.pixels.resize(mip.width * mip.height * pixel_size);
+
+            for (unsigned int y = 0; y < mip.height; ++y)
+            {
+                for (unsigned int x = 0; x < mip.width; ++x)
+                {
+                    // Odd sizes just clamp to the edge
+                    const unsigned int x0 = std::min(x * 2, previous.width - 1);
+                    const unsigned int x1 = std::min(x * 2 + 1, previous.width - 1);
+                    const unsigned int y0 = std::min(y * 2, previous.height - 1);
+                    const unsigned int y1 = std::min(y * 2 + 1, previous.height - 1);
+
+                    for (unsigned int c = 0; c < pixel_size; ++c)
+                    {
+                        const auto texel = [&](unsigned int tx, unsigned int ty)
+                        {
+                            return (unsigned int)previous.pixels[(ty * previous.width + tx) * pixel_size + c];
+                        };
+
+                        const unsigned int sum = texel(x0, y0) + texel(x1, y0) + texel(x0, y1) + texel(x1, y1);
+                        mip.pixels[(y * mip.width + x) * pixel_size + c] = (unsigned char)((sum + 2) / 4);
+                    }
+                }
+            }
+
+            mips.push_back(std::move(mip));
+        }
+
+        // Only the low mips are uploaded up front; the rest are streamed in on demand
+        base_resident_mip = 0;
+        while (base_resident_mip + 1 < mips.size() &&
+            std::max(mips[base_resident_mip].width, mips[base_resident_mip].height) > TEXTURE_BASE_MIP_SIZE)
+            ++base_resident_mip;
+
+        resident_mip = base_resident_mip;
+        requested_mip = base_resident_mip;
+        for (unsigned int i = resident_mip; i < mips.size(); ++i)
+            upload_mip(i);
+
+        glTexParameteri(texture_type, GL_TEXTURE_BASE_LEVEL, resident_mip);
+        glTexParameteri(texture_type, GL_TEXTURE_MAX_LEVEL, mips.size() - 1);
+    }
 
-    // Mipmaps
-    glGenerateMipmap(texture_type);
     glTexParameteri(texture_type, GL_TEXTURE_MIN_FILTER, use_nearest_filtering ? GL_NEAREST_MIPMAP_LINEAR : GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(texture_type, GL_TEXTURE_MAG_FILTER, use_nearest_filtering ? GL_NEAREST : GL_LINEAR);
 
@@ -41,14 +108,14 @@ Texture::Texture(const std::string& filename, const bool use_nearest_filtering)
     }
 
     // Unbind and free image from normal memory
-    glBindTexture(texture_type, 0);
+    gl_state::bind_texture(0, texture_type, 0);
     stbi_image_free(data);
 }
 
 Texture::Texture(const std::array<std::string, 6> faces)
 {
     glGenTextures(1, &texture_id);
-    glBindTexture(texture_type, texture_id);
+    gl_state::bind_texture(0, texture_type, texture_id);
 
     // Load from disk
     int width, height, channels;
@@ -67,7 +134,7 @@ Texture::Texture(const std::array<std::string, 6> faces)
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-    glBindTexture(texture_type, 0);
+    gl_state::bind_texture(0, texture_type, 0);
 }
 
 Texture::Texture(
@@ -82,9 +149,14 @@ Texture::Texture(
 {
     if (depth)
         texture_type = GL_TEXTURE_3D;
+    this->width = width;
+    this->height = height;
+    this->internal_format = internal_format;
+    this->format = format;
+    this->type = type;
 
     glGenTextures(1, &texture_id);
-    glBindTexture(texture_type, texture_id);
+    gl_state::bind_texture(0, texture_type, texture_id);
 
     if (depth) glTexImage3D(texture_type, 0, internal_format, width, height, depth, 0, format, type, data);
     else glTexImage2D(texture_type, 0, internal_format, width, height, 0, format, type, data);
@@ -93,44 +165,151 @@ Texture::Texture(
     glTexParameteri(texture_type, GL_TEXTURE_MAG_FILTER, use_nearest_filtering ? GL_NEAREST : GL_LINEAR);
     glTexParameteri(texture_type, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(texture_type, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glBindTexture(texture_type, 0);
+    gl_state::bind_texture(0, texture_type, 0);
 }
 
 void Texture::clamp(const glm::vec4& colour, const bool to_border) const
 {
     const float border_colour[] = { colour.r, colour.g, colour.b, colour.a };
-    glBindTexture(texture_type, texture_id);
+    gl_state::bind_texture(0, texture_type, texture_id);
     glTexParameteri(texture_type, GL_TEXTURE_WRAP_S, to_border ? GL_CLAMP_TO_BORDER : GL_CLAMP_TO_EDGE);
     glTexParameteri(texture_type, GL_TEXTURE_WRAP_T, to_border ? GL_CLAMP_TO_BORDER : GL_CLAMP_TO_EDGE);
     glTexParameterfv(texture_type, GL_TEXTURE_BORDER_COLOR, border_colour);
-    glBindTexture(texture_type, 0);
+    gl_state::bind_texture(0, texture_type, 0);
 }
 
 void Texture::set_as_texture_atlas(const int max_mipmap_level) const
 {
     // Limit mip-mapping so sub-textures don't go smaller than 1x1
-    glBindTexture(texture_type, texture_id);
+    gl_state::bind_texture(0, texture_type, texture_id);
     glTexParameteri(texture_type, GL_TEXTURE_MAX_LEVEL, max_mipmap_level);
-    glBindTexture(texture_type, 0);
+    gl_state::bind_texture(0, texture_type, 0);
+}
+
+unsigned int Texture::allocate_mips() const
+{
+    unsigned int levels = 1;
+    unsigned int level_width = width;
+    unsigned int level_height = height;
+
+    gl_state::bind_texture(0, texture_type, texture_id);
+    while (level_width > 1 || level_height > 1)
+    {
+        level_width = std::max(level_width / 2, 1u);
+        level_height = std::max(level_height / 2, 1u);
+        glTexImage2D(texture_type, levels++, internal_format, level_width, level_height, 0, format, type, NULL);
+    }
+
+    // Keep whichever filtering it was made with
+    int mag_filter;
+    glGetTexParameteriv(texture_type, GL_TEXTURE_MAG_FILTER, &mag_filter);
+    glTexParameteri(texture_type, GL_TEXTURE_MIN_FILTER, mag_filter == GL_NEAREST ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(texture_type, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    gl_state::bind_texture(0, texture_type, 0);
+    return levels;
+}
+
+bool Texture::is_streamed() const
+{
+    return !mips.empty();
+}
+
+unsigned int Texture::mip_count() const
+{
+    return mips.size();
+}
+
+void Texture::request_screen_size(const float pixels)
+{
+    if (!is_streamed()) return;
+
+    // Coarsest mip that still has at least one texel per pixel
+    const float texels = (float)std::max(mips[0].width, mips[0].height);
+    const float lod = std::log2(texels / std::max(pixels, 1.0f));
+    const unsigned int level = (unsigned int)std::clamp(lod, 0.0f, (float)mips.size() - 1.0f);
+
+    requested_mip = used_this_frame ? std::min(requested_mip, level) : level;
+    used_this_frame = true;
+}
+
+size_t Texture::next_mip_size() const
+{
+    if (!is_streamed() || resident_mip == 0) return 0;
+    return mips[resident_mip - 1].pixels.size();
+}
+
+size_t Texture::stream_in()
+{
+    if (!is_streamed() || resident_mip == 0) return 0;
+
+    // Upload the next finer mip, then let sampling see it
+    gl_state::bind_texture(0, texture_type, texture_id);
+    upload_mip(--resident_mip);
+    glTexParameteri(texture_type, GL_TEXTURE_BASE_LEVEL, resident_mip);
+    gl_state::bind_texture(0, texture_type, 0);
+    return mips[resident_mip].pixels.size();
+}
+
+size_t Texture::evict()
+{
+    if (!is_streamed() || resident_mip >= base_resident_mip) return 0;
+
+    // Stop sampling the finest mip first, then release its storage
+    const unsigned int level = resident_mip++;
+    gl_state::bind_texture(0, texture_type, texture_id);
+    glTexParameteri(texture_type, GL_TEXTURE_BASE_LEVEL, resident_mip);
+    glTexImage2D(texture_type, level, internal_format, 0, 0, 0, format, GL_UNSIGNED_BYTE, NULL);
+    gl_state::bind_texture(0, texture_type, 0);
+    return mips[level].pixels.size();
+}
+
+size_t Texture::resident_size() const
+{
+    size_t size = 0;
+    for (unsigned int i = resident_mip; i < mips.size(); ++i)
+        size += mips[i].pixels.size();
+    return size;
+}
+
+size_t Texture::total_size() const
+{
+    size_t size = 0;
+    for (const auto& mip : mips)
+        size += mip.pixels.size();
+    return size;
+}
+
+void Texture::upload_mip(const unsigned int level) const
+{
+    // Small RGB mips don't have 4-byte aligned rows
+    const MipLevel& mip = mips[level];
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(texture_type, level, internal_format, mip.width, mip.height, 0, format, GL_UNSIGNED_BYTE, mip.pixels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 }
 
 void Texture::bind(const unsigned int unit) const
 {
-    glActiveTexture(GL_TEXTURE0 + unit);
-    glBindTexture(texture_type, texture_id);
+    gl_state::bind_texture(unit, texture_type, texture_id);
+}
+
+void Texture::bind_image(const unsigned int internal_format, const unsigned int access, const unsigned int unit, const unsigned int level) const
+{
+    glBindImageTexture(unit, texture_id, level, GL_FALSE, 0, access, internal_format);
 }
 
-void Texture::bind_image(const unsigned int internal_format, const unsigned int access) const
+unsigned int Texture::get_internal_format() const
 {
-    glBindImageTexture(0, texture_id, 0, GL_FALSE, 0, access, internal_format);
+    return internal_format;
 }
 
 void Texture::unbind() const
 {
-    glBindTexture(texture_type, 0);
+    gl_state::bind_texture(0, texture_type, 0);
 }
 
 Texture::~Texture()
 {
+    gl_state::forget_texture(texture_id);
     glDeleteTextures(1, &texture_id);
 }
@@ -0,0 +1,271 @@
+#include "transform.h"
+#include "cpu_profiler.h"
+#include <vector>
+#include <stdexcept>
+
+constexpr uint32_t no_node = ~0u;
+
+struct TransformNode
+{
+    glm::vec3 position;
+    glm::quat rotation;
+    glm::vec3 scale;
+    uint32_t parent = no_node;
+
+    // Children form an intrusive list, so (un)parenting is constant time
+    uint32_t first_child = no_node;
+    uint32_t next_sibling = no_node;
+    uint32_t previous_sibling = no_node;
+
+    // Bumped whenever the world matrix changes, so children can tell
+    uint32_t version = 0;
+    uint32_t parent_version = 0;
+    bool dirty = true;
+    bool alive = true;
+};
+
+static std::vector<TransformNode> nodes;
+static std::vector<glm::mat4> world_matrices;
+static std::vector<uint32_t> free_nodes;
+
+// Moved-from transforms no longer own a node
+static void check_node(const uint32_t node)
+{
+    if (node == no_node) throw std::runtime_error("use of a moved-from transform");
+}
+
+static TransformNode& get_node(const uint32_t node)
+{
+    check_node(node);
+    return nodes[node];
+}
+
+static void detach(const uint32_t node)
+{
+    TransformNode& transform = nodes[node];
+    if (transform.parent == no_node) return;
+
+    if (transform.previous_sibling != no_node) nodes[transform.previous_sibling].next_sibling = transform.next_sibling;
+    else nodes[transform.parent].first_child = transform.next_sibling;
+    if (transform.next_sibling != no_node) nodes[transform.next_sibling].previous_sibling = transform.previous_sibling;
+
+    transform.parent = no_node;
+    transform.next_sibling = no_node;
+    transform.previous_sibling = no_node;
+    transform.dirty = true;
+}
+
+static void attach(const uint32_t node, const uint32_t parent)
+{
+    // A node can't be its own ancestor - resolve() would never finish
+    for (uint32_t ancestor = parent; ancestor != no_node; ancestor = nodes[ancestor].parent)
+        if (ancestor == node) throw std::runtime_error("transform can't be parented to itself or its descendants");
+
+    detach(node);
+    if (parent == no_node) return;
+
+    TransformNode& transform = nodes[node];
+    transform.parent = parent;
+    transform.next_sibling = nodes[parent].first_child;
+    if (transform.next_sibling != no_node) nodes[transform.next_sibling].previous_sibling = node;
+    nodes[parent].first_child = node;
+    transform.dirty = true;
+}
+
+// Takes value's parent, but never its children
+static uint32_t allocate_node(const TransformNode& value)
+{
+    TransformNode transform = value;
+    transform.parent = no_node;
+    transform.first_child = no_node;
+    transform.next_sibling = no_node;
+    transform.previous_sibling = no_node;
+
+    uint32_t node;
+    if (free_nodes.empty())
+    {
+        nodes.push_back(transform);
+        world_matrices.emplace_back(1.0f);
+        node = nodes.size() - 1;
+    }
+    else
+    {
+        node = free_nodes.back();
+        free_nodes.pop_back();
+        nodes[node] = transform;
+    }
+
+    attach(node, value.parent);
+    return node;
+}
+
+static void free_node(const uint32_t node)
+{
+    if (node == no_node) return;
+    detach(node);
+
+    // Orphan any children
+    uint32_t child = nodes[node].first_child;
+    while (child != no_node)
+    {
+        TransformNode& orphan = nodes[child];
+        child = orphan.next_sibling;
+        orphan.parent = no_node;
+        orphan.next_sibling = no_node;
+        orphan.previous_sibling = no_node;
+        orphan.dirty = true;
+    }
+
+    nodes[node].first_child = no_node;
+    nodes[node].alive = false;
+    free_nodes.push_back(node);
+}
+
+static const glm::mat4& resolve(const uint32_t node)
+{
+    TransformNode& transform = nodes[node];
+
+    // Parents first, so we know if they've moved
+    if (transform.parent != no_node)
+    {
+        resolve(transform.parent);
+        if (nodes[transform.parent].version != transform.parent_version)
+            transform.dirty = true;
+    }
+
+    if (transform.dirty)
+    {
+        glm::mat4 matrix = glm::translate(glm::mat4(1.0f), transform.position);
+        matrix *= glm::mat4_cast(transform.rotation);
+        matrix = glm::scale(matrix, transform.scale);
+
+        if (transform.parent != no_node)
+        {
+            matrix = world_matrices[transform.parent] * matrix;
+            transform.parent_version = nodes[transform.parent].version;
+        }
+
+        world_matrices[node] = matrix;
+        transform.version++;
+        transform.dirty = false;
+    }
+
+    return world_matrices[node];
+}
+
+void update_transforms()
+{
+    PROFILE_ZONE("update_transforms");
+    for (uint32_t i = 0; i < nodes.size(); ++i)
+        if (nodes[i].alive) resolve(i);
+}
+
+Transform::Transform(const glm::vec3 position, const glm::vec3 rotation, const glm::vec3 scale)
+{
+    node = allocate_node({ position, {}, scale });
+    set_rotation(rotation);
+}
+
+Transform::Transform(const Transform& other)
+{
+    TransformNode copy = get_node(other.node);
+    copy.dirty = true;
+    node = allocate_node(copy);
+}
+
+Transform::Transform(Transform&& other) noexcept : node(other.node)
+{
+    other.node = no_node;
+}
+
+Transform& Transform::operator=(const Transform& other)
+{
+    if (this == &other) return *this;
+
+    TransformNode copy = get_node(other.node);
+    copy.dirty = true;
+    if (node == no_node)
+    {
+        node = allocate_node(copy);
+        return *this;
+    }
+
+    // Keep our own children
+    TransformNode& transform = nodes[node];
+    transform.position = copy.position;
+    transform.rotation = copy.rotation;
+    transform.scale = copy.scale;
+    transform.dirty = true;
+    attach(node, copy.parent);
+    return *this;
+}
+
+Transform& Transform::operator=(Transform&& other) noexcept
+{
+    if (this == &other) return *this;
+
+    free_node(node);
+    node = other.node;
+    other.node = no_node;
+    return *this;
+}
+
+Transform::~Transform()
+{
+    free_node(node);
+}
+
+glm::vec3 Transform::get_position() const { return get_node(node).position; }
+glm::quat Transform::get_rotation() const { return get_node(node).rotation; }
+glm::vec3 Transform::get_scale() const { return get_node(node).scale; }
+
+void Transform::set_position(const glm::vec3& position)
+{
+    TransformNode& transform = get_node(node);
+    transform.position = position;
+    transform.dirty = true;
+}
+
+void Transform::set_rotation(const glm::quat& rotation)
+{
+    TransformNode& transform = get_node(node);
+    transform.rotation = rotation;
+    transform.dirty = true;
+}
+
+void Transform::set_rotation(const glm::vec3& euler_degrees)
+{
+    set_rotation(
+        glm::angleAxis(glm::radians(euler_degrees.x), glm::vec3(1, 0, 0)) *
+        glm::angleAxis(glm::radians(euler_degrees.y), glm::vec3(0, 1, 0)) *
+        glm::angleAxis(glm::radians(euler_degrees.z), glm::vec3(0, 0, 1))
+    );
+}
+
+void Transform::set_scale(const glm::vec3& scale)
+{
+    TransformNode& transform = get_node(node);
+    transform.scale = scale;
+    transform.dirty = true;
+}
+
+void Transform::set_parent(const Transform* parent)
+{
+    if (parent) check_node(parent->node);
+
+    check_node(node);
+    attach(node, parent ? parent->node : no_node);
+}
+
+glm::mat4 Transform::matrix() const
+{
+    check_node(node);
+    return resolve(node);
+}
+
+uint32_t Transform::version() const
+{
+    check_node(node);
+    resolve(node);
+    return nodes[node].version;
+}
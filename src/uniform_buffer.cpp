@@ -0,0 +1,25 @@
+#include "uniform_buffer.h"
+#include <glad/glad.h>
+
+UniformBuffer::UniformBuffer(const size_t size, const unsigned int binding) : size(size)
+{
+    glGenBuffers(1, &ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    // Stays bound to its binding point for good - shaders find it by block name
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo);
+}
+
+void UniformBuffer::update(const void* data) const
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformBuffer::~UniformBuffer()
+{
+    glDeleteBuffers(1, &ubo);
+}
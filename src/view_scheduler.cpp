@@ -0,0 +1,156 @@
+#include "view_scheduler.h"
+#include "cpu_profiler.h"
+#include "imgui.h"
+#include <glad/glad.h>
+#include <algorithm>
+
+OffscreenView::OffscreenView(const std::string& name, const float priority) :
+    name(name), priority(priority)
+{
+    glGenQueries(query_count, queries.data());
+}
+
+OffscreenView::~OffscreenView()
+{
+    glDeleteQueries(query_count, queries.data());
+}
+
+void OffscreenView::begin_update()
+{
+    // Skip timing this one if every query's still in flight
+    timing = !pending[next_query];
+    if (timing) glBeginQuery(GL_TIME_ELAPSED, queries[next_query]);
+}
+
+void OffscreenView::end_update()
+{
+    if (!timing) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[next_query] = true;
+    next_query = (next_query + 1) % query_count;
+    timing = false;
+}
+
+bool OffscreenView::is_scheduled() const
+{
+    return scheduled;
+}
+
+void OffscreenView::collect_timings()
+{
+    for (unsigned int i = 0; i < query_count; ++i)
+    {
+        if (!pending[i]) continue;
+
+        int available = 0;
+        glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) continue;
+
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds);
+        pending[i] = false;
+
+        const float ms = nanoseconds / 1e6f;
+        stats.cost_ms = stats.cost_ms == 0.0f ? ms : stats.cost_ms + (ms - stats.cost_ms) * 0.1f;
+    }
+}
+
+void ViewScheduler::submit(OffscreenView& view, const bool stale, const bool urgent)
+{
+    view.stale = stale || urgent;
+    view.urgent = urgent;
+    view.scheduled = false;
+    submitted.push_back(&view);
+}
+
+void ViewScheduler::schedule()
+{
+    PROFILE_ZONE("ViewScheduler::schedule");
+    views.swap(submitted);
+    submitted.clear();
+    planned_ms = 0.0f;
+
+    std::vector<OffscreenView*> candidates;
+    bool any_scheduled = false;
+    for (auto* view : views)
+    {
+        view->collect_timings();
+        if (!view->stale) continue;
+
+        if (view->urgent)
+        {
+            view->scheduled = true;
+            planned_ms += view->stats.cost_ms;
+            any_scheduled = true;
+        }
+        else candidates.push_back(view);
+    }
+
+    // Whatever's waited longest (weighted by priority) goes first
+    std::stable_sort(candidates.begin(), candidates.end(), [](const OffscreenView* a, const OffscreenView* b)
+    {
+        return (a->stats.staleness + 1) * a->priority > (b->stats.staleness + 1) * b->priority;
+    });
+
+    for (auto* view : candidates)
+    {
+        if (any_scheduled && planned_ms + view->stats.cost_ms > budget_ms) continue;
+        view->scheduled = true;
+        planned_ms += view->stats.cost_ms;
+        any_scheduled = true;
+    }
+
+    for (auto* view : views)
+    {
+        if (view->scheduled)
+        {
+            view->stats.updates++;
+            if (view->urgent) view->stats.urgent_updates++;
+            view->stats.staleness = 0;
+        }
+        else if (view->stale)
+        {
+            view->stats.deferrals++;
+            view->stats.staleness++;
+            view->stats.max_staleness = std::max(view->stats.max_staleness, view->stats.staleness);
+        }
+    }
+}
+
+void ViewScheduler::draw_gui()
+{
+    ImGui::Begin("Offscreen views");
+    ImGui::SliderFloat("Budget (ms)", &budget_ms, 0.0f, 8.0f);
+    ImGui::Text("Planned: %.2f ms", planned_ms);
+    if (ImGui::BeginTable("views", 7, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+    {
+        ImGui::TableSetupColumn("View");
+        ImGui::TableSetupColumn("Priority");
+        ImGui::TableSetupColumn("Cost (ms)");
+        ImGui::TableSetupColumn("Updates");
+        ImGui::TableSetupColumn("Urgent");
+        ImGui::TableSetupColumn("Deferred");
+        ImGui::TableSetupColumn("Staleness (max)");
+        ImGui::TableHeadersRow();
+        for (const auto* view : views)
+        {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(view->name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", view->priority);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", view->stats.cost_ms);
+            ImGui::TableNextColumn();
+            ImGui::Text("%u", view->stats.updates);
+            ImGui::TableNextColumn();
+            ImGui::Text("%u", view->stats.urgent_updates);
+            ImGui::TableNextColumn();
+            ImGui::Text("%u", view->stats.deferrals);
+            ImGui::TableNextColumn();
+            ImGui::Text("%u (%u)", view->stats.staleness, view->stats.max_staleness);
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
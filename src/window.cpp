@@ -1,14 +1,41 @@
 #include "window.h"
+#include "cpu_profiler.h"
 #include "config.h"
 #include <stdexcept>
 #include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstring>
 
-Window::Window(const std::string& name, const int _width, const int _height) :
-    width(_width), height(_height)
+#if HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#endif
+
+Window::Window(const std::string& name, const int _width, const int _height, const bool _headless) :
+    width(_width), height(_height), headless(_headless)
 {
-    // Create window and accompanying OpenGL context
-    init_glfw(name);
-    init_glad();
+    // Create window (or just an offscreen target) and accompanying OpenGL context
+    if (headless)
+    {
+        // Passes halve (and quarter...) the size, so it can't be tiny
+        if (width < HEADLESS_MIN_SIZE || height < HEADLESS_MIN_SIZE)
+            throw std::runtime_error("headless size must be at least " +
+                std::to_string(HEADLESS_MIN_SIZE) + "x" + std::to_string(HEADLESS_MIN_SIZE));
+
+        init_egl();
+        init_glad();
+        init_output_framebuffer();
+    }
+    else
+    {
+        init_glfw(name);
+        init_glad();
+    }
 
 #ifndef __APPLE__
 #if DEBUG
@@ -21,6 +48,15 @@ Window::Window(const std::string& name, const int _width, const int _height) :
 
 bool Window::update()
 {
+    PROFILE_ZONE("Window::update");
+
+    // Nothing to present or poll - just make sure the frame gets submitted
+    if (headless)
+    {
+        glFlush();
+        return true;
+    }
+
 #ifdef __APPLE__
     // Fix stuttering
     glFinish();
@@ -43,11 +79,36 @@ bool Window::update()
 
 void Window::set_title(const std::string& title) const
 {
+    if (headless) return;
     glfwSetWindowTitle(window, title.c_str());
 }
 
+double Window::get_time() const
+{
+    if (!headless) return glfwGetTime();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+void Window::save_screenshot(const std::string& filename) const
+{
+    std::vector<unsigned char> pixels(framebuffer_width * framebuffer_height * 3);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, output_framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, framebuffer_width, framebuffer_height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) throw std::runtime_error("unable to write screenshot " + filename);
+
+    // PPM rows go top to bottom, GL's bottom to top
+    file << "P6\n" << framebuffer_width << " " << framebuffer_height << "\n255\n";
+    const size_t row_size = framebuffer_width * 3;
+    for (int y = framebuffer_height - 1; y >= 0; --y)
+        file.write(reinterpret_cast<const char*>(&pixels[y * row_size]), row_size);
+}
+
 bool Window::get_key(const int key, const bool repeat) const
 {
+    if (headless) return false;
     if (repeat == false && key >= 0 && key <= GLFW_KEY_LAST)
         return glfwGetKey(window, key) == GLFW_PRESS && !cached_keyboard_buttons[key];
 
@@ -56,6 +117,7 @@ bool Window::get_key(const int key, const bool repeat) const
 
 bool Window::get_mouse_button(const int button, const bool repeat) const
 {
+    if (headless) return false;
     if (repeat == false && button >= 0 && button <= 2)
         return glfwGetMouseButton(window, button) == GLFW_PRESS && !cached_mouse_buttons[button];
 
@@ -64,6 +126,8 @@ bool Window::get_mouse_button(const int button, const bool repeat) const
 
 glm::vec2 Window::mouse_position() const
 {
+    if (headless) return {};
+
     double x, y;
     glfwGetCursorPos(window, &x, &y);
     return { x, y };
@@ -71,11 +135,13 @@ glm::vec2 Window::mouse_position() const
 
 void Window::capture_mouse() const
 {
+    if (headless) return;
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 }
 
 void Window::uncapture_mouse() const
 {
+    if (headless) return;
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
 }
 
@@ -122,19 +188,117 @@ void Window::init_glfw(const std::string& name)
     glfwSwapInterval(VSYNC);
 }
 
+void Window::init_egl()
+{
+#if HEADLESS_EGL
+    // Mesa's surfaceless platform needs no display server at all (and works
+    // with llvmpipe); anywhere else, make do with the default display
+    EGLDisplay display = EGL_NO_DISPLAY;
+    const char* client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (client_extensions && std::strstr(client_extensions, "EGL_MESA_platform_surfaceless"))
+    {
+        auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (get_platform_display)
+            display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+        throw std::runtime_error("unable to initialise EGL");
+    egl_display = display;
+
+    if (!eglBindAPI(EGL_OPENGL_API)) throw std::runtime_error("EGL has no desktop OpenGL");
+
+    // Only need a pbuffer if surfaceless contexts aren't supported
+    const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+    const bool surfaceless = extensions && std::strstr(extensions, "EGL_KHR_surfaceless_context");
+
+    const EGLint config_attributes[] = {
+        EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint n_configs = 0;
+    if (!eglChooseConfig(display, config_attributes, &config, 1, &n_configs) || n_configs == 0)
+        throw std::runtime_error("no suitable EGL config");
+
+    // Same as the windowed context - OpenGL core >= 4.3 (these share their
+    // values with EGL_KHR_create_context's, so are fine on 1.4 too)
+    std::vector<EGLint> context_attributes = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT
+    };
+
+    // Debug contexts are core in 1.5, but only a flag before that
+#if DEBUG
+    if (major > 1 || (major == 1 && minor >= 5))
+        context_attributes.insert(context_attributes.end(), { EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE });
+    else if (extensions && std::strstr(extensions, "EGL_KHR_create_context"))
+        context_attributes.insert(context_attributes.end(), { EGL_CONTEXT_FLAGS_KHR, EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR });
+#endif
+    context_attributes.push_back(EGL_NONE);
+
+    egl_context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes.data());
+    if (egl_context == EGL_NO_CONTEXT) throw std::runtime_error("unable to create EGL context");
+
+    if (!surfaceless)
+    {
+        const EGLint surface_attributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        egl_surface = eglCreatePbufferSurface(display, config, surface_attributes);
+        if (egl_surface == EGL_NO_SURFACE) throw std::runtime_error("unable to create EGL pbuffer");
+    }
+
+    if (!eglMakeCurrent(display, egl_surface, egl_surface, egl_context))
+        throw std::runtime_error("unable to make EGL context current");
+
+    // No window, so no scaling between window and framebuffer
+    framebuffer_width = width;
+    framebuffer_height = height;
+#else
+    throw std::runtime_error("headless mode needs EGL, which this build doesn't have");
+#endif
+}
+
 void Window::init_glad()
 {
     // GLAD will load OpenGL for us
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+#if HEADLESS_EGL
+    const GLADloadproc loader = headless ? (GLADloadproc)eglGetProcAddress : (GLADloadproc)glfwGetProcAddress;
+#else
+    const GLADloadproc loader = (GLADloadproc)glfwGetProcAddress;
+#endif
+    if (!gladLoadGLLoader(loader))
         throw std::runtime_error("failed to initialise GLAD");
 }
 
+void Window::init_output_framebuffer()
+{
+    // Stands in for the default framebuffer (so colour + depth/stencil)
+    glGenFramebuffers(1, &output_framebuffer);
+    glGenRenderbuffers(2, output_renderbuffers);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, output_renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, framebuffer_width, framebuffer_height);
+    glBindRenderbuffer(GL_RENDERBUFFER, output_renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, framebuffer_width, framebuffer_height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, output_framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, output_renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, output_renderbuffers[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        throw std::runtime_error("headless output framebuffer is incomplete");
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
 void Window::enable_debugging()
 {
     // Load debug context synchronously (i.e. raise errors as soon as they happen)
     glEnable(GL_DEBUG_OUTPUT);
     glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
-    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
+    if (!headless) glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
 
     glDebugMessageCallback([]
     (
@@ -199,5 +363,18 @@ void Window::enable_debugging()
 
 Window::~Window()
 {
-    glfwTerminate();
+    if (!headless)
+    {
+        glfwTerminate();
+        return;
+    }
+
+    glDeleteFramebuffers(1, &output_framebuffer);
+    glDeleteRenderbuffers(2, output_renderbuffers);
+#if HEADLESS_EGL
+    eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (egl_surface) eglDestroySurface(egl_display, egl_surface);
+    if (egl_context) eglDestroyContext(egl_display, egl_context);
+    eglTerminate(egl_display);
+#endif
 }